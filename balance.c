@@ -1,34 +1,64 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
-#define MAX_STACK_SIZE 1000
+#define CHUNK_SIZE (1 << 24) // bytes read at a time in --file mode, split among the threads
+#define PARALLEL_MIN (1 << 18) // smallest piece worth handing to another thread
+
+static int thread_count = 1;
+
+// Stack structure: run-length encoded, so a run of the same opener (the
+// usual case for deep nesting of one bracket type) is just a counter, and
+// it grows as needed instead of dropping anything
+typedef struct {
+    char c;
+    long long count;
+} Run;
 
-// Stack structure
 typedef struct {
-    char data[MAX_STACK_SIZE];
-    int top;
+    Run *data;
+    long long top; // index of the top run, -1 when empty
+    long long capacity;
 } Stack;
 
 // Stack functions
 
-void pushFunction(Stack *s, char c) {
-    if (s->top < MAX_STACK_SIZE - 1) { //checks if the stack is not full
-        s->data[++s->top] = c; //pushes the character c onto the stack 
+void pushRun(Stack *s, char c, long long count) {
+    if (s->top >= 0 && s->data[s->top].c == c) { //same opener as the top: extend the run
+        s->data[s->top].count += count;
+        return;
+    }
+    if (s->top + 1 == s->capacity) { //grows the stack when it is full
+        s->capacity = s->capacity ? 2 * s->capacity : 64;
+        s->data = (Run *)realloc(s->data, s->capacity * sizeof(Run));
     }
+    s->data[++s->top] = (Run){ c, count }; //pushes count copies of c onto the stack
+}
+
+void pushFunction(Stack *s, char c) {
+    pushRun(s, c, 1);
 }
 
 char popFunction(Stack *s) {
     if (s->top >= 0) { //checks if the stack is not empty
-        return s->data[s->top--]; //pops the top character from the stack 
+        char c = s->data[s->top].c;
+        if (--s->data[s->top].count == 0) s->top--; //pops the top character from the stack
+        return c;
     }
     return '\0'; // Empty stack
 
 }
 
-char peekFunction(Stack *s) { //returns the top character of the stack 
+char peekFunction(Stack *s) { //returns the top character of the stack
     if (s->top >= 0) { //checks if the stack is not empty
-        return s->data[s->top]; // returns the top character of the stack 
+        return s->data[s->top].c; // returns the top character of the stack
     }
     return '\0';
 }
@@ -40,40 +70,217 @@ int is_matching_pair(char open, char close) { //checks if the open and close cha
            (open == '{' && close == '}');
 }
 
-int main(int argc, char *argv[]) {
-    if (argc != 2) { //checks if the number of arguments passed is not equal to 2
-        fprintf(stderr, "Usage: %s '<string>'\n", argv[0]);
-        return EXIT_FAILURE;
+// Checker state carried across chunks; offset is the 64-bit index of the next byte
+typedef struct {
+    Stack stack;
+    long long offset;
+} Checker;
+
+// What one piece of the input leaves unresolved: the closers it could not
+// match (in order; they need openers from before the piece), a mismatch inside
+// the piece itself, and the openers still open at its end. Pieces are scanned
+// independently and their summaries folded left to right, so a violation is
+// reported at exactly the position a sequential scan would have stopped.
+typedef struct {
+    const char *input;
+    size_t length;
+    long long offset; // index of input[0] in the whole stream
+    Stack closers;
+    Stack openers;
+    long long error; // index of the first mismatched closer inside the piece, or -1
+} Summary;
+
+static inline int isBracket(char c) {
+    return c == '(' || c == ')' || c == '[' || c == ']' || c == '{' || c == '}';
+}
+
+#ifdef __AVX2__
+// Marks the bracket bytes of a 32-byte block with two nibble lookups: each
+// byte's high and low nibble index a class table, and only the six brackets
+// have a bit set in both
+static inline uint32_t bracketMask(const char *p) {
+    const __m256i high_table = _mm256_setr_epi8(
+        0, 0, 0x03, 0, 0, 0x0C, 0, 0x30, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0x03, 0, 0, 0x0C, 0, 0x30, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i low_table = _mm256_setr_epi8(
+        0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x02, 0, 0x14, 0, 0x28, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0x02, 0, 0x14, 0, 0x28, 0, 0);
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i high = _mm256_shuffle_epi8(high_table, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    __m256i low = _mm256_shuffle_epi8(low_table, _mm256_and_si256(v, nibble));
+    __m256i none = _mm256_cmpeq_epi8(_mm256_and_si256(high, low), _mm256_setzero_si256());
+    return ~(uint32_t)_mm256_movemask_epi8(none);
+}
+#endif
+
+// Applies one bracket to a summary; returns 0 at a mismatch inside the piece
+static inline int scanBracket(Summary *s, char c, long long index) {
+    if (c == '(' || c == '[' || c == '{') {
+        pushFunction(&s->openers, c);
+        return 1;
+    }
+    char top = popFunction(&s->openers);
+    if (top == '\0') {
+        pushFunction(&s->closers, c); //unmatched here; an earlier piece may open it
+        return 1;
+    }
+    if (!is_matching_pair(top, c)) {
+        s->error = index;
+        return 0;
+    }
+    return 1;
+}
+
+// Summarizes one piece, visiting only the bracket bytes
+static void *summarizePiece(void *arg) {
+    Summary *s = (Summary *)arg;
+    const char *input = s->input;
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 32 <= s->length; i += 32) {
+        for (uint32_t mask = bracketMask(input + i); mask != 0; mask &= mask - 1) {
+            int bit = __builtin_ctz(mask);
+            if (!scanBracket(s, input[i + bit], s->offset + (long long)(i + bit))) return NULL;
+        }
     }
+#endif
+    for (; i < s->length; i++) {
+        if (isBracket(input[i]) && !scanBracket(s, input[i], s->offset + (long long)i)) return NULL;
+    }
+    return NULL;
+}
 
-    char *input = argv[1]; //sets the input character pointer to the second argument passed
-    Stack stack = {.top = -1}; //creates, declares and initializes a stack 
-    for (int i = 0; input[i] != '\0'; i++) {
-        char c = input[i]; //creates declares and intializes the character c
-        if (c == '(' || c == '[' || c == '{') {
-            pushFunction(&stack, c); //calls the push function to push character c onto stack
+// Index of the k-th (0-based) unmatched closer of a piece, found by rescanning it
+static long long locateCloser(const Summary *s, long long k) {
+    Stack openers = { NULL, -1, 0 };
+    long long index = -1;
+    for (size_t i = 0; i < s->length && index < 0; i++) {
+        char c = s->input[i];
+        if (c == '(' || c == '[' || c == '{') pushFunction(&openers, c);
+        else if ((c == ')' || c == ']' || c == '}') && popFunction(&openers) == '\0' && k-- == 0)
+            index = s->offset + (long long)i;
+    }
+    free(openers.data);
+    return index;
+}
 
-        } 
-        else if (c == ')' || c == ']' || c == '}') {
-            char top = popFunction(&stack); //calls the pop function to remove the first character from the stack
-            if (top == '\0' || !is_matching_pair(top, c)) {
-                printf("%d: %c\n", i, c);
-                return EXIT_FAILURE;
+// Folds a piece's summary onto the stack of everything before it; prints the
+// "index: char" diagnostic and returns 0 at the first violation
+static int foldSummary(Checker *checker, const Summary *s) {
+    Stack *stack = &checker->stack;
+    long long k = 0; //index of the current closer among the piece's unmatched closers
+    for (long long r = 0; r <= s->closers.top; r++) {
+        Run run = s->closers.data[r];
+        while (run.count > 0) {
+            if (stack->top < 0 || !is_matching_pair(stack->data[stack->top].c, run.c)) {
+                printf("%lld: %c\n", locateCloser(s, k), run.c);
+                return 0;
             }
+            long long n = run.count < stack->data[stack->top].count ? run.count : stack->data[stack->top].count;
+            if ((stack->data[stack->top].count -= n) == 0) stack->top--;
+            run.count -= n;
+            k += n;
         }
     }
+    if (s->error >= 0) {
+        printf("%lld: %c\n", s->error, s->input[s->error - s->offset]);
+        return 0;
+    }
+    for (long long r = 0; r <= s->openers.top; r++) pushRun(stack, s->openers.data[r].c, s->openers.data[r].count);
+    return 1;
+}
+
+// Scans one chunk, split across up to thread_count threads; prints "index: char"
+// and returns 0 at the first bad closer
+int checkChunk(Checker *checker, const char *input, size_t length) {
+    int parts = thread_count;
+    if ((size_t)parts > length / PARALLEL_MIN) parts = (int)(length / PARALLEL_MIN);
+    if (parts < 1) parts = 1;
+
+    Summary summaries[parts];
+    pthread_t ids[parts];
+    size_t piece = length / parts;
+    for (int p = 0; p < parts; p++) {
+        size_t first = p * piece;
+        size_t last = p == parts - 1 ? length : first + piece;
+        summaries[p] = (Summary){ input + first, last - first, checker->offset + (long long)first,
+                                  { NULL, -1, 0 }, { NULL, -1, 0 }, -1 };
+        if (p > 0) pthread_create(&ids[p], NULL, summarizePiece, &summaries[p]);
+    }
+    summarizePiece(&summaries[0]);
+    for (int p = 1; p < parts; p++) pthread_join(ids[p], NULL);
 
-    if (stack.top >= 0) {
-        printf("open: ");
-        while (stack.top >= 0) { //while the stack is NOT empty
-            char open = popFunction(&stack); //calls the pop function to remove the first character, open, from the stack
-            if (open == '(') printf(")");
-            else if (open == '[') printf("]");
-            else if (open == '{') printf("}");
-        }
-        printf("\n");
+    int ok = 1;
+    for (int p = 0; p < parts; p++) {
+        if (ok) ok = foldSummary(checker, &summaries[p]);
+        free(summaries[p].closers.data);
+        free(summaries[p].openers.data);
+    }
+    checker->offset += length;
+    return ok;
+}
+
+// Prints "open: " and the closers still needed, innermost first; returns 0 if any were
+int finishCheck(Checker *checker) {
+    Stack *stack = &checker->stack;
+    if (stack->top < 0) return 1;
+    char closers[4096];
+    printf("open: ");
+    for (; stack->top >= 0; stack->top--) { //while the stack is NOT empty
+        char open = stack->data[stack->top].c;
+        char close = open == '(' ? ')' : open == '[' ? ']' : '}';
+        memset(closers, close, sizeof(closers));
+        for (long long count = stack->data[stack->top].count; count > 0; count -= (long long)sizeof(closers))
+            fwrite(closers, 1, count < (long long)sizeof(closers) ? (size_t)count : sizeof(closers), stdout);
+    }
+    printf("\n");
+    return 0;
+}
+
+// Streams a file ("-" for stdin) through the checker in CHUNK_SIZE reads, so memory
+// stays bounded whatever the thread count
+int checkFile(Checker *checker, const char *path) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        perror("Error opening file");
+        return -1;
+    }
+    char *buffer = (char *)malloc(CHUNK_SIZE);
+    int ok = 1;
+    size_t got;
+    while (ok && (got = fread(buffer, 1, CHUNK_SIZE, file)) > 0) {
+        ok = checkChunk(checker, buffer, got);
+    }
+    free(buffer);
+    if (file != stdin) fclose(file);
+    return ok;
+}
+
+int main(int argc, char *argv[]) {
+    Checker checker = { { NULL, -1, 0 }, 0 }; //creates, declares and initializes an empty stack
+    int ok;
+    int argi = 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    thread_count = cpus > 0 ? (int)cpus : 1;
+    if (argi + 1 < argc && strcmp(argv[argi], "--threads") == 0) {
+        thread_count = atoi(argv[argi + 1]);
+        if (thread_count < 1) thread_count = 1;
+        argi += 2;
+    }
+    if (argc - argi == 2 && strcmp(argv[argi], "--file") == 0) {
+        ok = checkFile(&checker, argv[argi + 1]);
+        if (ok < 0) return EXIT_FAILURE;
+    } else if (argc - argi == 1) { //checks the string passed as the argument
+        ok = checkChunk(&checker, argv[argi], strlen(argv[argi]));
+    } else {
+        fprintf(stderr, "Usage: %s [--threads N] '<string>'\n", argv[0]);
+        fprintf(stderr, "       %s [--threads N] --file <path|->\n", argv[0]);
         return EXIT_FAILURE;
     }
-    return EXIT_SUCCESS;
 
-}
\ No newline at end of file
+    if (ok) ok = finishCheck(&checker);
+    free(checker.stack.data);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+
+}
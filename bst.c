@@ -1,132 +1,1301 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define POOL_SLAB_NODES 4096
+#define MAX_HEIGHT 64 // an AVL tree this tall would need more than 10^13 nodes
+#define BTREE_KEYS 16 // keys per B+-tree node: one 64-byte cache line of ints
+#define BTREE_MAX_HEIGHT 16 // non-root nodes keep at least half their fan-out
+#define BENCH_LOOKUPS 4000000
+#define BATCH_SIZE 256 // commands parsed ahead and executed together
+#define OUTPUT_BUFFER (1 << 20)
+#define SKIP_LEVELS 32
+#define CONCURRENT_MAX_THREADS 32
+#define CONCURRENT_OPS 4000000
+#define CHECK_KEYS 16
+#define CHECK_OPS 20000 // per thread
 
 typedef struct Node {
     int value;
+    int height; // height of the subtree rooted here; a leaf has height 1
     struct Node *left, *right;
 } Node;
 
+// Nodes are carved out of large slabs; deleted nodes go on a free list
+// (linked through their left pointer) and are handed out again first
+typedef struct Slab {
+    struct Slab* next;
+    Node nodes[POOL_SLAB_NODES];
+} Slab;
+
+typedef struct {
+    Slab* slabs;
+    int used; // nodes handed out from the newest slab
+    Node* free_list;
+} NodePool;
+
+typedef struct {
+    Node* root;
+    NodePool pool;
+} Tree;
+
 // Function to create a new node for BST
-Node* create_node(int value) {
-    Node* new_node = (Node*)malloc(sizeof(Node));
+Node* create_node(NodePool* pool, int value) {
+    Node* new_node = pool->free_list;
+    if (new_node != NULL) {
+        pool->free_list = new_node->left;
+    } else {
+        if (pool->slabs == NULL || pool->used == POOL_SLAB_NODES) {
+            Slab* slab = (Slab*)malloc(sizeof(Slab));
+            slab->next = pool->slabs;
+            pool->slabs = slab;
+            pool->used = 0;
+        }
+        new_node = &pool->slabs->nodes[pool->used++];
+    }
     new_node->value = value;
+    new_node->height = 1;
     new_node->left = new_node->right = NULL;
     return new_node;
 }
 
-// Insert function for BST
-Node* insert(Node* root, int value, int* inserted) {
-    if (root == NULL) {
-        *inserted = 1;
-        return create_node(value);
+// Returns a node to the pool
+void release_node(NodePool* pool, Node* node) {
+    node->left = pool->free_list;
+    pool->free_list = node;
+}
+
+static inline int height(Node* node) {
+    return node ? node->height : 0;
+}
+
+static inline void update_height(Node* node) {
+    int l = height(node->left), r = height(node->right);
+    node->height = (l > r ? l : r) + 1;
+}
+
+static Node* rotate_right(Node* node) {
+    Node* pivot = node->left;
+    node->left = pivot->right;
+    pivot->right = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static Node* rotate_left(Node* node) {
+    Node* pivot = node->right;
+    node->right = pivot->left;
+    pivot->left = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+// Restores the AVL invariant (child heights differ by at most one) at node
+static Node* rebalance(Node* node) {
+    update_height(node);
+    int balance = height(node->left) - height(node->right);
+    if (balance > 1) {
+        if (height(node->left->left) < height(node->left->right))
+            node->left = rotate_left(node->left); //left-right case
+        return rotate_right(node);
+    }
+    if (balance < -1) {
+        if (height(node->right->right) < height(node->right->left))
+            node->right = rotate_right(node->right); //right-left case
+        return rotate_left(node);
     }
+    return node;
+}
+
+// Walks the recorded path bottom-up, stopping once a subtree's height is unchanged
+static void rebalance_path(Node** path[], int depth) {
+    while (depth-- > 0) {
+        Node** link = path[depth];
+        int old_height = (*link)->height;
+        *link = rebalance(*link);
+        if ((*link)->height == old_height) break;
+    }
+}
 
-    if (value < root->value) //if the value of the child is less than the value of the parent
-        root->left = insert(root->left, value, inserted); //inserts it to the left of the tree
-    else if (value > root->value) //if the value of the child is greater than the value of the parent
-        root->right = insert(root->right, value, inserted); //inserts it to the right of the tree
-    return root;
+// Insert function for BST; returns 1 if the value was not already present
+int insert(Tree* tree, int value) {
+    Node** path[MAX_HEIGHT];
+    int depth = 0;
+    Node** link = &tree->root;
+    while (*link != NULL) {
+        if (value == (*link)->value) return 0;
+        path[depth++] = link;
+        link = value < (*link)->value ? &(*link)->left : &(*link)->right; //left if smaller, right if greater
+    }
+    *link = create_node(&tree->pool, value);
+    rebalance_path(path, depth);
+    return 1;
 }
 
 // Search function for BST
-int search(Node* root, int value) {
-    if (root == NULL) return 0; //if root does not exist
-    if (root->value == value) return 1; //if the value of the root is equal to the search value 
-    if (value < root->value) return search(root->left, value); //if search value is less than the value of root then traverse left
-    return search(root->right, value); //recursively calls search if the search value is greater than the value of root
-}
-
-// Find the maximum value in a subtree of a BST
-Node* find_max(Node* root) {
-    while (root->right != NULL) root = root->right;
-    return root;
-}
-
-// Delete function for BST
-Node* delete(Node* root, int value, int* deleted) {
-    if (root == NULL) return NULL;
-    if (value < root->value) //checks if search value is less than the value of the root
-        root->left = delete(root->left, value, deleted); //traverses to left of tree and deletes it
-    else if (value > root->value) //checks if search value is greater than the value of the root
-        root->right = delete(root->right, value, deleted); //traveses to right of tree and deletes it
-    else {
-        *deleted = 1;
-        if (root->left == NULL) {
-            Node* temp = root->right;
-            free(root);
-            return temp;
-        } 
-        else if (root->right == NULL) 
-        {
-            Node* temp = root->left;
-            free(root);
-            return temp;
-        }
-
-        Node* max_left = find_max(root->left);
-        root->value = max_left->value;
-        root->left = delete(root->left, max_left->value, deleted); //recursively calls delete to delete the maximum left node
-    }
-
-    return root;
-}
-
-// Print function that prints the binary search tree
-void print_tree(Node* root) {
-    if (root == NULL) return;
-    printf("(");
-    print_tree(root->left);
-    printf("%d", root->value);
-    print_tree(root->right);
-    printf(")");
-}
-
-// Free memory
-void free_tree(Node* root) {
-    if (root == NULL) return;
-    free_tree(root->left);
-    free_tree(root->right);
-    free(root);
-}
-
-int main() {
-    Node* root = NULL;
-    char command;
+int search(const Tree* tree, int value) {
+    Node* node = tree->root;
+    while (node != NULL) {
+        if (node->value == value) return 1;
+        node = value < node->value ? node->left : node->right;
+    }
+    return 0;
+}
+
+// Batched search: every lookup advances one level per round and prefetches
+// its next node, so up to BATCH_SIZE cache misses are in flight at once
+void search_batch(const Tree* tree, const int* values, int count, char* found) {
+    const Node* cur[BATCH_SIZE];
+    for (int i = 0; i < count; i++) {
+        cur[i] = tree->root;
+        found[i] = 0;
+    }
+    for (int active = count; active > 0; ) {
+        active = 0;
+        for (int i = 0; i < count; i++) {
+            const Node* node = cur[i];
+            if (node == NULL) continue;
+            if (node->value == values[i]) {
+                found[i] = 1;
+                cur[i] = NULL;
+                continue;
+            }
+            node = values[i] < node->value ? node->left : node->right;
+            if (node != NULL) {
+                __builtin_prefetch(node);
+                active++;
+            }
+            cur[i] = node;
+        }
+    }
+}
+
+// Delete function for BST; a node with two children takes the maximum of its
+// left subtree, as before. Returns 1 if the value was present.
+int delete(Tree* tree, int value) {
+    Node** path[MAX_HEIGHT];
+    int depth = 0;
+    Node** link = &tree->root;
+    while (*link != NULL && (*link)->value != value) {
+        path[depth++] = link;
+        link = value < (*link)->value ? &(*link)->left : &(*link)->right;
+    }
+    if (*link == NULL) return 0;
+
+    Node* target = *link;
+    if (target->left != NULL && target->right != NULL) {
+        //finds the maximum left node, moves its value up and unlinks it instead
+        path[depth++] = link;
+        link = &target->left;
+        while ((*link)->right != NULL) {
+            path[depth++] = link;
+            link = &(*link)->right;
+        }
+        target->value = (*link)->value;
+    }
+    Node* removed = *link;
+    *link = removed->left != NULL ? removed->left : removed->right;
+    release_node(&tree->pool, removed);
+    rebalance_path(path, depth);
+    return 1;
+}
+
+// All results go through one large buffer that is written out when full
+static char out_buf[OUTPUT_BUFFER];
+static size_t out_len;
+
+static void flush_output(void) {
+    fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+}
+
+static inline void put_chars(const char* s, size_t n) {
+    if (out_len + n > OUTPUT_BUFFER) flush_output();
+    memcpy(out_buf + out_len, s, n);
+    out_len += n;
+}
+
+static inline void put_char(char c) {
+    if (out_len == OUTPUT_BUFFER) flush_output();
+    out_buf[out_len++] = c;
+}
+
+static void put_int(int value) {
+    char digits[12];
+    int n = 0;
+    unsigned magnitude = value < 0 ? -(unsigned)value : (unsigned)value;
+    do {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (value < 0) digits[n++] = '-';
+    char text[12];
+    for (int i = 0; i < n; i++) text[i] = digits[n - 1 - i];
+    put_chars(text, n);
+}
+
+// Prints keys[lo..hi) as the balanced binary tree over them, in the (left value right)
+// format. Every backend prints p this way, so the output depends only on the keys
+// and not on the backend or the order they were inserted in.
+static void print_sorted(const int* keys, long lo, long hi) {
+    if (lo >= hi) return;
+    long mid = lo + (hi - lo) / 2;
+    put_char('(');
+    print_sorted(keys, lo, mid);
+    put_int(keys[mid]);
+    print_sorted(keys, mid + 1, hi);
+    put_char(')');
+}
+
+// Print function that prints the binary search tree: its keys are collected in
+// order with an explicit stack and printed in the canonical shape
+void print_tree(const Tree* tree) {
+    Node* stack[MAX_HEIGHT];
+    int top = 0;
+    long n = 0, capacity = 1024;
+    int* keys = (int*)malloc(capacity * sizeof(int));
+    for (Node* node = tree->root; node != NULL || top > 0; ) {
+        if (node != NULL) {
+            stack[top++] = node;
+            node = node->left;
+        } else {
+            node = stack[--top];
+            if (n == capacity) keys = (int*)realloc(keys, (capacity *= 2) * sizeof(int));
+            keys[n++] = node->value;
+            node = node->right;
+        }
+    }
+    print_sorted(keys, 0, n);
+    free(keys);
+}
+
+// Free memory: every node lives in a slab, so the slabs are all there is to release
+void free_tree(Tree* tree) {
+    Slab* slab = tree->pool.slabs;
+    while (slab != NULL) {
+        Slab* next = slab->next;
+        free(slab);
+        slab = next;
+    }
+    tree->root = NULL;
+    tree->pool = (NodePool){ NULL, 0, NULL };
+}
+
+// B+-tree backend for search-heavy workloads: wide nodes whose keys fill one
+// cache line, searched without branches. Values live in the leaves; internal
+// node keys[i] separates children[i] (smaller values) from children[i + 1].
+typedef struct BNode {
+    int keys[BTREE_KEYS];
+    int count;
+    int leaf;
+    struct BNode* next; // leaves only: right neighbour, for in-order walks
+    struct BNode* children[]; // internal nodes only: count + 1 children
+} BNode;
+
+typedef struct {
+    BNode* root;
+    long size;
+} BTree;
+
+BNode* create_bnode(int leaf) {
+    size_t bytes = sizeof(BNode) + (leaf ? 0 : (BTREE_KEYS + 1) * sizeof(BNode*));
+    BNode* node = (BNode*)aligned_alloc(64, (bytes + 63) / 64 * 64);
+    memset(node, 0, bytes);
+    node->leaf = leaf;
+    return node;
+}
+
+// Number of keys[0..count) that are <= value, from two 8-wide compares and a popcount
+static inline int rank_le(const int* keys, int count, int value) {
+#ifdef __AVX2__
+    __m256i v = _mm256_set1_epi32(value);
+    __m256i gt0 = _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i*)keys), v);
+    __m256i gt1 = _mm256_cmpgt_epi32(_mm256_load_si256((const __m256i*)(keys + 8)), v);
+    unsigned gt = (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(gt0))
+                | (unsigned)_mm256_movemask_ps(_mm256_castsi256_ps(gt1)) << 8;
+    return __builtin_popcount(~gt & ((1u << count) - 1));
+#else
+    int rank = 0;
+    for (int i = 0; i < BTREE_KEYS; i++) rank += (i < count) & (keys[i] <= value);
+    return rank;
+#endif
+}
+
+int btree_search(const BTree* tree, int value) {
+    const BNode* node = tree->root;
+    if (node == NULL) return 0;
+    while (!node->leaf) node = node->children[rank_le(node->keys, node->count, value)];
+    int rank = rank_le(node->keys, node->count, value);
+    return rank > 0 && node->keys[rank - 1] == value;
+}
+
+// Searches a run of values together, one tree level per round, so the
+// node fetches of different lookups overlap instead of serializing
+void btree_search_batch(const BTree* tree, const int* values, int count, char* found) {
+    const BNode* cur[BATCH_SIZE];
+    if (tree->root == NULL) {
+        memset(found, 0, count);
+        return;
+    }
+    for (int i = 0; i < count; i++) cur[i] = tree->root;
+    //all leaves are at the same depth, so every lookup descends in lockstep
+    for (const BNode* level = tree->root; !level->leaf; level = level->children[0]) {
+        for (int i = 0; i < count; i++) {
+            cur[i] = cur[i]->children[rank_le(cur[i]->keys, cur[i]->count, values[i])];
+            __builtin_prefetch(cur[i]);
+            __builtin_prefetch((const char*)cur[i] + 64);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        int rank = rank_le(cur[i]->keys, cur[i]->count, values[i]);
+        found[i] = rank > 0 && cur[i]->keys[rank - 1] == values[i];
+    }
+}
+
+// Insert into the leaf, splitting full nodes on the way back up; returns 1 if the value was new
+int btree_insert(BTree* tree, int value) {
+    if (tree->root == NULL) tree->root = create_bnode(1);
+    BNode* path[BTREE_MAX_HEIGHT];
+    int slot[BTREE_MAX_HEIGHT];
+    int depth = 0;
+    BNode* node = tree->root;
+    while (!node->leaf) {
+        int child = rank_le(node->keys, node->count, value);
+        path[depth] = node;
+        slot[depth++] = child;
+        node = node->children[child];
+    }
+    int pos = rank_le(node->keys, node->count, value);
+    if (pos > 0 && node->keys[pos - 1] == value) return 0;
+    tree->size++;
+
+    if (node->count < BTREE_KEYS) {
+        memmove(node->keys + pos + 1, node->keys + pos, (node->count - pos) * sizeof(int));
+        node->keys[pos] = value;
+        node->count++;
+        return 1;
+    }
+
+    //full leaf: the lower half stays, the upper half moves to a new right sibling
+    int keys[BTREE_KEYS + 1];
+    memcpy(keys, node->keys, pos * sizeof(int));
+    keys[pos] = value;
+    memcpy(keys + pos + 1, node->keys + pos, (BTREE_KEYS - pos) * sizeof(int));
+    BNode* right = create_bnode(1);
+    node->count = (BTREE_KEYS + 1) / 2;
+    right->count = BTREE_KEYS + 1 - node->count;
+    memcpy(node->keys, keys, node->count * sizeof(int));
+    memcpy(right->keys, keys + node->count, right->count * sizeof(int));
+    right->next = node->next;
+    node->next = right;
+    int separator = right->keys[0];
+
+    while (depth > 0) {
+        BNode* parent = path[--depth];
+        pos = slot[depth];
+        if (parent->count < BTREE_KEYS) {
+            memmove(parent->keys + pos + 1, parent->keys + pos, (parent->count - pos) * sizeof(int));
+            memmove(parent->children + pos + 2, parent->children + pos + 1, (parent->count - pos) * sizeof(BNode*));
+            parent->keys[pos] = separator;
+            parent->children[pos + 1] = right;
+            parent->count++;
+            return 1;
+        }
+        //full internal node: the middle key moves up instead of being copied
+        BNode* children[BTREE_KEYS + 2];
+        memcpy(keys, parent->keys, pos * sizeof(int));
+        keys[pos] = separator;
+        memcpy(keys + pos + 1, parent->keys + pos, (BTREE_KEYS - pos) * sizeof(int));
+        memcpy(children, parent->children, (pos + 1) * sizeof(BNode*));
+        children[pos + 1] = right;
+        memcpy(children + pos + 2, parent->children + pos + 1, (BTREE_KEYS - pos) * sizeof(BNode*));
+        int half = BTREE_KEYS / 2;
+        right = create_bnode(0);
+        parent->count = half;
+        right->count = BTREE_KEYS - half;
+        memcpy(parent->keys, keys, half * sizeof(int));
+        memcpy(parent->children, children, (half + 1) * sizeof(BNode*));
+        memcpy(right->keys, keys + half + 1, right->count * sizeof(int));
+        memcpy(right->children, children + half + 1, (right->count + 1) * sizeof(BNode*));
+        separator = keys[half];
+    }
+
+    BNode* root = create_bnode(0);
+    root->count = 1;
+    root->keys[0] = separator;
+    root->children[0] = tree->root;
+    root->children[1] = right;
+    tree->root = root;
+    return 1;
+}
+
+// Removes the value from its leaf. Underfull leaves are not merged: the
+// separators above them stay valid bounds, so searches still route correctly.
+int btree_delete(BTree* tree, int value) {
+    BNode* node = tree->root;
+    if (node == NULL) return 0;
+    while (!node->leaf) node = node->children[rank_le(node->keys, node->count, value)];
+    int pos = rank_le(node->keys, node->count, value);
+    if (pos == 0 || node->keys[pos - 1] != value) return 0;
+    memmove(node->keys + pos - 1, node->keys + pos, (node->count - pos) * sizeof(int));
+    node->count--;
+    tree->size--;
+    return 1;
+}
+
+// The B+-tree prints p in the same canonical shape as the other backends
+void btree_print(const BTree* tree) {
+    if (tree->root == NULL) return;
+    int* keys = (int*)malloc((tree->size ? tree->size : 1) * sizeof(int));
+    long n = 0;
+    const BNode* leaf = tree->root;
+    while (!leaf->leaf) leaf = leaf->children[0];
+    for (; leaf != NULL; leaf = leaf->next) {
+        memcpy(keys + n, leaf->keys, leaf->count * sizeof(int));
+        n += leaf->count;
+    }
+    print_sorted(keys, 0, n);
+    free(keys);
+}
+
+static void free_bnode(BNode* node) {
+    if (!node->leaf) {
+        for (int i = 0; i <= node->count; i++) free_bnode(node->children[i]);
+    }
+    free(node);
+}
+
+void btree_free(BTree* tree) {
+    if (tree->root != NULL) free_bnode(tree->root);
+    tree->root = NULL;
+    tree->size = 0;
+}
+
+// Concurrent backend: the lazy skiplist of Herlihy, Lev, Luchangco and Shavit.
+// Searches take no locks and never retry; insert and delete lock only the
+// predecessors they relink and validate them before writing. A node is in the
+// set once fully_linked is set and until marked is set, which makes those two
+// stores the linearization points of insert and delete.
+typedef struct SkipNode {
     int value;
+    int top_level;
+    atomic_flag lock;
+    atomic_int marked;
+    atomic_int fully_linked;
+    struct SkipNode* retired_next;
+    _Atomic(struct SkipNode*) next[]; // top_level + 1 forward links
+} SkipNode;
+
+// Unlinked nodes may still be under a concurrent search, so they are kept on
+// the retired list and freed with the list itself
+typedef struct {
+    SkipNode* head; // sentinel below every value; its own value is never compared
+    _Atomic(SkipNode*) retired;
+    atomic_long size;
+} SkipList;
+
+static SkipNode* create_skip_node(int value, int top_level) {
+    SkipNode* node = (SkipNode*)malloc(sizeof(SkipNode) + (top_level + 1) * sizeof(SkipNode*));
+    node->value = value;
+    node->top_level = top_level;
+    atomic_flag_clear(&node->lock);
+    atomic_init(&node->marked, 0);
+    atomic_init(&node->fully_linked, 0);
+    for (int l = 0; l <= top_level; l++) atomic_init(&node->next[l], NULL);
+    return node;
+}
+
+void skiplist_init(SkipList* list) {
+    list->head = create_skip_node(0, SKIP_LEVELS - 1);
+    atomic_init(&list->retired, NULL);
+    atomic_init(&list->size, 0);
+}
+
+static inline void lock_node(SkipNode* node) {
+    while (atomic_flag_test_and_set_explicit(&node->lock, memory_order_acquire)) sched_yield();
+}
+
+static inline void unlock_node(SkipNode* node) {
+    atomic_flag_clear_explicit(&node->lock, memory_order_release);
+}
 
-    while (scanf(" %c", &command) == 1) {
-        if (command == 'i') {
-            if (scanf("%d", &value) == 1) {
-                int inserted = 0;
-                root = insert(root, value, &inserted);
-                printf("%s\n", inserted ? "inserted" : "not inserted");
+// Releases preds[0..highest], each distinct node once
+static void unlock_preds(SkipNode* preds[], int highest) {
+    for (int l = 0; l <= highest; l++) {
+        if (l == 0 || preds[l] != preds[l - 1]) unlock_node(preds[l]);
+    }
+}
+
+// Geometric level with p = 1/2 from a per-thread xorshift generator
+static int random_level(void) {
+    static _Thread_local uint64_t seed;
+    if (seed == 0) seed = (uint64_t)(uintptr_t)&seed * 0x9E3779B97F4A7C15ull | 1;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    return __builtin_ctzll(seed | 1ull << (SKIP_LEVELS - 1));
+}
+
+// Fills the predecessor and successor of value on every level; returns the
+// highest level where value was seen, or -1
+static int skiplist_find(const SkipList* list, int value, SkipNode* preds[], SkipNode* succs[]) {
+    int found = -1;
+    SkipNode* pred = list->head;
+    for (int l = SKIP_LEVELS - 1; l >= 0; l--) {
+        SkipNode* curr = atomic_load(&pred->next[l]);
+        while (curr != NULL && curr->value < value) {
+            pred = curr;
+            curr = atomic_load(&pred->next[l]);
+        }
+        if (found == -1 && curr != NULL && curr->value == value) found = l;
+        preds[l] = pred;
+        succs[l] = curr;
+    }
+    return found;
+}
+
+int skiplist_search(const SkipList* list, int value) {
+    SkipNode* pred = list->head;
+    SkipNode* curr = NULL;
+    for (int l = SKIP_LEVELS - 1; l >= 0; l--) {
+        curr = atomic_load(&pred->next[l]);
+        while (curr != NULL && curr->value < value) {
+            pred = curr;
+            curr = atomic_load(&pred->next[l]);
+        }
+        if (curr != NULL && curr->value == value)
+            return atomic_load(&curr->fully_linked) && !atomic_load(&curr->marked);
+    }
+    return 0;
+}
+
+int skiplist_insert(SkipList* list, int value) {
+    SkipNode* preds[SKIP_LEVELS];
+    SkipNode* succs[SKIP_LEVELS];
+    int top_level = random_level();
+    for (;;) {
+        int found = skiplist_find(list, value, preds, succs);
+        if (found != -1) {
+            SkipNode* node = succs[found];
+            if (!atomic_load(&node->marked)) {
+                //present, or about to be: wait for the inserter so the answer is linearizable
+                while (!atomic_load(&node->fully_linked)) sched_yield();
+                return 0;
             }
-        } 
-
-        else if (command == 's') 
-        {
-            if (scanf("%d", &value) == 1) 
-                printf("%s\n", search(root, value) ? "present" : "absent");
-        } 
-
-        else if (command == 'p') 
-        {
-            print_tree(root);
-            printf("\n");
-        } 
-
-        else if (command == 'd') 
-        {
-            if (scanf("%d", &value) == 1) {
-                int deleted = 0;
-                root = delete(root, value, &deleted);
-                printf("%s\n", deleted ? "deleted" : "absent");
+            continue; //being deleted; retry once it is unlinked
+        }
+
+        int highest = -1, valid = 1;
+        for (int l = 0; valid && l <= top_level; l++) {
+            if (l == 0 || preds[l] != preds[l - 1]) lock_node(preds[l]);
+            highest = l;
+            valid = !atomic_load(&preds[l]->marked) && (succs[l] == NULL || !atomic_load(&succs[l]->marked))
+                    && atomic_load(&preds[l]->next[l]) == succs[l];
+        }
+        if (!valid) {
+            unlock_preds(preds, highest);
+            continue;
+        }
+
+        SkipNode* node = create_skip_node(value, top_level);
+        for (int l = 0; l <= top_level; l++) atomic_store(&node->next[l], succs[l]);
+        for (int l = 0; l <= top_level; l++) atomic_store(&preds[l]->next[l], node);
+        atomic_store(&node->fully_linked, 1);
+        atomic_fetch_add(&list->size, 1);
+        unlock_preds(preds, highest);
+        return 1;
+    }
+}
+
+int skiplist_delete(SkipList* list, int value) {
+    SkipNode* preds[SKIP_LEVELS];
+    SkipNode* succs[SKIP_LEVELS];
+    SkipNode* victim = NULL;
+    int is_marked = 0, top_level = -1;
+    for (;;) {
+        int found = skiplist_find(list, value, preds, succs);
+        if (!is_marked) {
+            if (found == -1) return 0;
+            victim = succs[found];
+            //only a fully inserted node, found at its own top level, can be deleted
+            if (!atomic_load(&victim->fully_linked) || victim->top_level != found || atomic_load(&victim->marked))
+                return 0;
+            top_level = victim->top_level;
+            lock_node(victim);
+            if (atomic_load(&victim->marked)) {
+                unlock_node(victim);
+                return 0;
             }
-        } 
-        else 
+            atomic_store(&victim->marked, 1);
+            is_marked = 1;
+        }
+
+        int highest = -1, valid = 1;
+        for (int l = 0; valid && l <= top_level; l++) {
+            if (l == 0 || preds[l] != preds[l - 1]) lock_node(preds[l]);
+            highest = l;
+            valid = !atomic_load(&preds[l]->marked) && atomic_load(&preds[l]->next[l]) == victim;
+        }
+        if (!valid) {
+            unlock_preds(preds, highest);
+            continue;
+        }
+
+        for (int l = top_level; l >= 0; l--) atomic_store(&preds[l]->next[l], atomic_load(&victim->next[l]));
+        atomic_fetch_sub(&list->size, 1);
+        unlock_node(victim);
+        unlock_preds(preds, highest);
+        victim->retired_next = atomic_load(&list->retired);
+        while (!atomic_compare_exchange_weak(&list->retired, &victim->retired_next, victim)) {
+        }
+        return 1;
+    }
+}
+
+// The skiplist prints p in the same canonical shape as the other backends; only
+// call it while no other thread is writing
+void skiplist_print(const SkipList* list) {
+    long size = atomic_load(&list->size);
+    int* keys = (int*)malloc((size ? size : 1) * sizeof(int));
+    long n = 0;
+    for (SkipNode* node = atomic_load(&list->head->next[0]); node != NULL && n < size; node = atomic_load(&node->next[0]))
+        keys[n++] = node->value;
+    print_sorted(keys, 0, n);
+    free(keys);
+}
+
+void skiplist_free(SkipList* list) {
+    SkipNode* node = list->head;
+    while (node != NULL) {
+        SkipNode* next = atomic_load(&node->next[0]);
+        free(node);
+        node = next;
+    }
+    node = atomic_load(&list->retired);
+    while (node != NULL) {
+        SkipNode* next = node->retired_next;
+        free(node);
+        node = next;
+    }
+    list->head = NULL;
+    atomic_store(&list->retired, NULL);
+    atomic_store(&list->size, 0);
+}
+
+// The backend is chosen at startup with --backend
+typedef enum { BACKEND_AVL, BACKEND_BTREE, BACKEND_SKIPLIST } Backend;
+
+typedef struct {
+    Backend backend;
+    Tree avl;
+    BTree btree;
+    SkipList skiplist;
+} Set;
+
+static void set_init(Set* set, Backend backend) {
+    memset(set, 0, sizeof(Set));
+    set->backend = backend;
+    if (backend == BACKEND_SKIPLIST) skiplist_init(&set->skiplist);
+}
+
+static int set_insert(Set* set, int value) {
+    switch (set->backend) {
+    case BACKEND_BTREE: return btree_insert(&set->btree, value);
+    case BACKEND_SKIPLIST: return skiplist_insert(&set->skiplist, value);
+    default: return insert(&set->avl, value);
+    }
+}
+
+static int set_search(const Set* set, int value) {
+    switch (set->backend) {
+    case BACKEND_BTREE: return btree_search(&set->btree, value);
+    case BACKEND_SKIPLIST: return skiplist_search(&set->skiplist, value);
+    default: return search(&set->avl, value);
+    }
+}
+
+static void set_search_batch(const Set* set, const int* values, int count, char* found) {
+    switch (set->backend) {
+    case BACKEND_BTREE:
+        btree_search_batch(&set->btree, values, count, found);
+        break;
+    case BACKEND_SKIPLIST:
+        for (int i = 0; i < count; i++) found[i] = (char)skiplist_search(&set->skiplist, values[i]);
+        break;
+    default:
+        search_batch(&set->avl, values, count, found);
+    }
+}
+
+static int set_delete(Set* set, int value) {
+    switch (set->backend) {
+    case BACKEND_BTREE: return btree_delete(&set->btree, value);
+    case BACKEND_SKIPLIST: return skiplist_delete(&set->skiplist, value);
+    default: return delete(&set->avl, value);
+    }
+}
+
+static void set_print(const Set* set) {
+    switch (set->backend) {
+    case BACKEND_BTREE: btree_print(&set->btree); break;
+    case BACKEND_SKIPLIST: skiplist_print(&set->skiplist); break;
+    default: print_tree(&set->avl);
+    }
+}
+
+static void set_free(Set* set) {
+    switch (set->backend) {
+    case BACKEND_BTREE: btree_free(&set->btree); break;
+    case BACKEND_SKIPLIST: skiplist_free(&set->skiplist); break;
+    default: free_tree(&set->avl);
+    }
+}
+
+static double elapsed_seconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Distinct keys in scattered order: multiplying by an odd constant is a bijection mod 2^32
+static inline int bench_key(long i) {
+    return (int)((unsigned)i * 2654435761u);
+}
+
+// Builds each backend from n scattered keys and times BENCH_LOOKUPS searches,
+// half of them hits, for n = 10^6, 10^7, ... up to max_keys
+void benchmark_lookup(long max_keys) {
+    static const char* names[] = { "avl", "btree" };
+    printf("%10s %8s %10s %12s %10s\n", "keys", "backend", "build_s", "lookup_Mops", "hits");
+    int* queries = (int*)malloc(BENCH_LOOKUPS * sizeof(int));
+    for (long n = 1000000; n <= max_keys; n *= 10) {
+        srand(211);
+        for (long q = 0; q < BENCH_LOOKUPS; q++) {
+            long i = ((long)rand() * RAND_MAX + rand()) % (2 * n);
+            queries[q] = bench_key(i); //keys with i >= n were never inserted
+        }
+        for (int b = BACKEND_AVL; b <= BACKEND_BTREE; b++) {
+            Set set;
+            set_init(&set, (Backend)b);
+            struct timespec start;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (long i = 0; i < n; i++) set_insert(&set, bench_key(i));
+            double build_time = elapsed_seconds(&start);
+
+            long hits = 0;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            for (long q = 0; q < BENCH_LOOKUPS; q++) hits += set_search(&set, queries[q]);
+            double lookup_time = elapsed_seconds(&start);
+            printf("%10ld %8s %10.2f %12.2f %10ld\n", n, names[b], build_time,
+                   BENCH_LOOKUPS / lookup_time * 1e-6, hits);
+            set_free(&set);
+        }
+    }
+    free(queries);
+}
+
+// The whole command stream, mapped when stdin is a file and read into memory otherwise
+typedef struct {
+    char* base;
+    const char* cur;
+    const char* end;
+    size_t size;
+    int mapped;
+} CommandReader;
+
+void open_reader(CommandReader* r, int fd) {
+    struct stat st;
+    r->mapped = 0;
+    r->base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        r->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        r->size = st.st_size;
+    }
+    if (r->base != MAP_FAILED) {
+        r->mapped = 1;
+        posix_madvise(r->base, r->size, POSIX_MADV_SEQUENTIAL);
+    } else {
+        size_t cap = 1 << 16;
+        r->base = malloc(cap);
+        r->size = 0;
+        for (ssize_t got; (got = read(fd, r->base + r->size, cap - r->size)) > 0; ) {
+            r->size += got;
+            if (r->size == cap) r->base = realloc(r->base, cap *= 2);
+        }
+    }
+    r->cur = r->base;
+    r->end = r->base + r->size;
+}
+
+void close_reader(CommandReader* r) {
+    if (r->mapped) munmap(r->base, r->size);
+    else free(r->base);
+}
+
+static inline int is_space(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Reads the next non-space character, as scanf(" %c") did
+static inline int read_command(CommandReader* r, char* command) {
+    while (r->cur < r->end && is_space(*r->cur)) r->cur++;
+    if (r->cur == r->end) return 0;
+    *command = *r->cur++;
+    return 1;
+}
+
+// Parses an int the way scanf("%d") did: optional sign, digits saturated to
+// the range of long and then narrowed. A lone sign is consumed and fails.
+static inline int read_int(CommandReader* r, int* value) {
+    while (r->cur < r->end && is_space(*r->cur)) r->cur++;
+    int negative = 0;
+    if (r->cur < r->end && (*r->cur == '-' || *r->cur == '+')) negative = *r->cur++ == '-';
+    if (r->cur == r->end || *r->cur < '0' || *r->cur > '9') return 0;
+    unsigned long magnitude = 0, limit = negative ? -(unsigned long)LONG_MIN : LONG_MAX;
+    for (; r->cur < r->end && *r->cur >= '0' && *r->cur <= '9'; r->cur++) {
+        unsigned digit = *r->cur - '0';
+        magnitude = magnitude > (limit - digit) / 10 ? limit : magnitude * 10 + digit;
+    }
+    *value = (int)(negative ? (long)(0 - magnitude) : (long)magnitude);
+    return 1;
+}
+
+typedef struct {
+    char op;
+    int value;
+} Command;
+
+// Parses up to BATCH_SIZE commands; returns the count and sets *stop at end
+// of input or at an unknown command. A command whose value fails to parse is
+// dropped, and parsing resumes at the offending character.
+static int read_batch(CommandReader* r, Command* batch, int* stop) {
+    int count = 0;
+    while (count < BATCH_SIZE) {
+        char command;
+        if (!read_command(r, &command)) {
+            *stop = 1;
             break;
+        }
+        if (command == 'p') {
+            batch[count++] = (Command){ command, 0 };
+        } else if (command == 'i' || command == 's' || command == 'd') {
+            int value;
+            if (read_int(r, &value)) batch[count++] = (Command){ command, value };
+        } else {
+            *stop = 1;
+            break;
+        }
+    }
+    return count;
+}
+
+// Runs one batch in order; consecutive searches are resolved together
+static void run_batch(Set* set, const Command* batch, int count) {
+    int values[BATCH_SIZE];
+    char found[BATCH_SIZE];
+    for (int c = 0; c < count; ) {
+        const Command* cmd = &batch[c];
+        if (cmd->op == 's') {
+            int run = 0;
+            while (c + run < count && batch[c + run].op == 's') {
+                values[run] = batch[c + run].value;
+                run++;
+            }
+            set_search_batch(set, values, run, found);
+            for (int i = 0; i < run; i++) {
+                if (found[i]) put_chars("present\n", 8);
+                else put_chars("absent\n", 7);
+            }
+            c += run;
+            continue;
+        }
+        if (cmd->op == 'i') {
+            if (set_insert(set, cmd->value)) put_chars("inserted\n", 9);
+            else put_chars("not inserted\n", 13);
+        } else if (cmd->op == 'd') {
+            if (set_delete(set, cmd->value)) put_chars("deleted\n", 8);
+            else put_chars("absent\n", 7);
+        } else {
+            set_print(set);
+            put_char('\n');
+        }
+        c++;
+    }
+}
+
+// Replays commands[first], commands[first + stride], ... against a shared set
+typedef struct {
+    Set* set;
+    const Command* commands;
+    long first, count, stride;
+} ReplayTask;
+
+static void* replay_commands(void* arg) {
+    ReplayTask* task = (ReplayTask*)arg;
+    for (long c = task->first; c < task->count; c += task->stride) {
+        const Command* cmd = &task->commands[c];
+        if (cmd->op == 'i') set_insert(task->set, cmd->value);
+        else if (cmd->op == 'd') set_delete(task->set, cmd->value);
+        else set_search(task->set, cmd->value);
+    }
+    return NULL;
+}
+
+// Reads every i/s/d command of a file; p has no meaning for a concurrent replay
+static Command* load_commands(const char* path, long* count) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    CommandReader reader;
+    open_reader(&reader, fd);
+    close(fd);
+    long cap = BATCH_SIZE;
+    Command* commands = (Command*)malloc(cap * sizeof(Command));
+    *count = 0;
+    for (int stop = 0; !stop; ) {
+        if (*count + BATCH_SIZE > cap) commands = (Command*)realloc(commands, (cap *= 2) * sizeof(Command));
+        int got = read_batch(&reader, commands + *count, &stop);
+        long kept = *count;
+        for (int c = 0; c < got; c++) {
+            if (commands[*count + c].op != 'p') commands[kept++] = commands[*count + c];
+        }
+        *count = kept;
+    }
+    close_reader(&reader);
+    return commands;
+}
+
+// Replays a command stream on the skiplist with 1, 2, 4, ... 32 threads, each
+// thread taking every T-th command. Without a file the stream is 10^6 scattered
+// inserts to preload, then CONCURRENT_OPS commands: 90% s, 5% i, 5% d.
+int benchmark_concurrent(const char* path) {
+    long count, preload = 0;
+    Command* commands;
+    if (path != NULL) {
+        commands = load_commands(path, &count);
+        if (commands == NULL) {
+            perror("Error opening file");
+            return 1;
+        }
+    } else {
+        preload = 1000000;
+        count = preload + CONCURRENT_OPS;
+        commands = (Command*)malloc(count * sizeof(Command));
+        srand(211);
+        for (long c = 0; c < count; c++) {
+            int roll = rand() % 100;
+            char op = c < preload ? 'i' : roll < 90 ? 's' : roll < 95 ? 'i' : 'd';
+            commands[c] = (Command){ op, bench_key(c < preload ? c : rand() % (2 * preload)) };
+        }
+    }
+    printf("%8s %8s %10s %10s %10s\n", "backend", "threads", "seconds", "Mops", "speedup");
+
+    double base_rate = 0;
+    for (int threads = 0; threads <= CONCURRENT_MAX_THREADS; threads = threads ? threads * 2 : 1) {
+        //threads == 0 is the single-threaded AVL baseline
+        Set set;
+        set_init(&set, threads ? BACKEND_SKIPLIST : BACKEND_AVL);
+        ReplayTask setup = { &set, commands, 0, preload, 1 };
+        replay_commands(&setup);
+
+        int workers = threads ? threads : 1;
+        ReplayTask tasks[CONCURRENT_MAX_THREADS];
+        pthread_t ids[CONCURRENT_MAX_THREADS];
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int t = 0; t < workers; t++) {
+            tasks[t] = (ReplayTask){ &set, commands, preload + t, count, workers };
+            pthread_create(&ids[t], NULL, replay_commands, &tasks[t]);
+        }
+        for (int t = 0; t < workers; t++) pthread_join(ids[t], NULL);
+        double seconds = elapsed_seconds(&start);
+        double rate = (count - preload) / seconds * 1e-6;
+        if (threads == 0) base_rate = rate; //speedup is relative to the AVL baseline
+        printf("%8s %8d %10.2f %10.2f %10.2f\n", threads ? "skiplist" : "avl", workers, seconds, rate,
+               rate / base_rate);
+        set_free(&set);
+    }
+    free(commands);
+    return 0;
+}
+
+// One operation of a recorded history; call and ret are ticks of a shared
+// counter taken just before and just after it ran
+typedef struct {
+    char op;
+    int value;
+    int result;
+    long call, ret;
+} HistoryOp;
+
+typedef struct {
+    Set* set;
+    HistoryOp* ops;
+    uint64_t seed;
+} HistoryTask;
+
+static atomic_long history_clock;
+
+static void* record_history(void* arg) {
+    HistoryTask* task = (HistoryTask*)arg;
+    uint64_t x = task->seed;
+    for (int i = 0; i < CHECK_OPS; i++) {
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        HistoryOp* h = &task->ops[i];
+        h->op = "isd"[x % 3];
+        h->value = (int)((x >> 8) % CHECK_KEYS);
+        h->call = atomic_fetch_add(&history_clock, 1);
+        if (h->op == 'i') h->result = set_insert(task->set, h->value);
+        else if (h->op == 'd') h->result = set_delete(task->set, h->value);
+        else h->result = set_search(task->set, h->value);
+        h->ret = atomic_fetch_add(&history_clock, 1);
+    }
+    return NULL;
+}
+
+// Call and return events of one key's history, in time order
+typedef struct Event {
+    long time;
+    int op;
+    int is_call;
+    struct Event *prev, *next, *match;
+} Event;
+
+static int compare_events(const void* a, const void* b) {
+    long ta = ((const Event*)a)->time, tb = ((const Event*)b)->time;
+    return (ta > tb) - (ta < tb);
+}
+
+// Takes an operation's call and return out of the event list, and puts them back
+static void lift(Event* call) {
+    call->prev->next = call->next;
+    if (call->next != NULL) call->next->prev = call->prev;
+    Event* ret = call->match;
+    ret->prev->next = ret->next;
+    if (ret->next != NULL) ret->next->prev = ret->prev;
+}
+
+static void unlift(Event* call) {
+    Event* ret = call->match;
+    ret->prev->next = ret;
+    if (ret->next != NULL) ret->next->prev = ret;
+    call->prev->next = call;
+    if (call->next != NULL) call->next->prev = call;
+}
+
+// Set of (linearized operations, membership) pairs already explored
+typedef struct {
+    int words;
+    size_t capacity, used;
+    uint64_t* bits;
+    char* state; // 0 empty, otherwise membership + 1
+} VisitedSet;
+
+static uint64_t hash_visit(const uint64_t* bits, int words, int state) {
+    uint64_t h = 1469598103934665603ull ^ (uint64_t)state;
+    for (int w = 0; w < words; w++) h = (h ^ bits[w]) * 1099511628211ull;
+    return h;
+}
+
+// Returns 1 if the pair was new
+static int visit(VisitedSet* v, const uint64_t* bits, int state) {
+    if (2 * (v->used + 1) > v->capacity) {
+        VisitedSet grown = { v->words, v->capacity ? 2 * v->capacity : 1024, 0, NULL, NULL };
+        grown.bits = (uint64_t*)malloc(grown.capacity * grown.words * sizeof(uint64_t));
+        grown.state = (char*)calloc(grown.capacity, 1);
+        for (size_t i = 0; i < v->capacity; i++) {
+            if (v->state[i]) visit(&grown, v->bits + i * v->words, v->state[i] - 1);
+        }
+        free(v->bits);
+        free(v->state);
+        *v = grown;
+    }
+    size_t i = hash_visit(bits, v->words, state) & (v->capacity - 1);
+    for (; v->state[i]; i = (i + 1) & (v->capacity - 1)) {
+        if (v->state[i] == state + 1 && memcmp(v->bits + i * v->words, bits, v->words * sizeof(uint64_t)) == 0)
+            return 0;
     }
+    v->state[i] = (char)(state + 1);
+    memcpy(v->bits + i * v->words, bits, v->words * sizeof(uint64_t));
+    v->used++;
+    return 1;
+}
+
+// Applies op to a key's membership; returns 0 if its recorded result is impossible
+static int apply_op(const HistoryOp* op, int present, int* next) {
+    *next = op->op == 'i' ? 1 : op->op == 'd' ? 0 : present;
+    return op->op == 'i' ? op->result == !present : op->result == present;
+}
+
+// Wing-Gong search with memoization (as in Lowe's checker) over one key's
+// history. Keys are independent, so the whole history is linearizable iff
+// every per-key history is.
+static int linearizable_key(HistoryOp* const* ops, int m) {
+    Event* events = (Event*)malloc((2 * m + 1) * sizeof(Event));
+    Event* head = &events[2 * m];
+    for (int i = 0; i < m; i++) {
+        events[2 * i] = (Event){ ops[i]->call, i, 1, NULL, NULL, NULL };
+        events[2 * i + 1] = (Event){ ops[i]->ret, i, 0, NULL, NULL, NULL };
+    }
+    qsort(events, 2 * m, sizeof(Event), compare_events);
+    Event** call_of = (Event**)malloc(m * sizeof(Event*));
+    Event* prev = head;
+    *head = (Event){ 0, -1, 0, NULL, NULL, NULL };
+    for (int e = 0; e < 2 * m; e++) {
+        events[e].prev = prev;
+        prev->next = &events[e];
+        prev = &events[e];
+        if (events[e].is_call) call_of[events[e].op] = &events[e];
+        else call_of[events[e].op]->match = &events[e];
+    }
+
+    VisitedSet visited = { (m + 63) / 64, 0, 0, NULL, NULL };
+    uint64_t* bits = (uint64_t*)calloc(visited.words, sizeof(uint64_t));
+    Event** stack = (Event**)malloc(m * sizeof(Event*));
+    int* saved = (int*)malloc(m * sizeof(int));
+    int top = 0, present = 0, ok = 1;
+    Event* e = head->next;
+    while (head->next != NULL) {
+        if (e->is_call) {
+            int next;
+            if (apply_op(ops[e->op], present, &next)) {
+                bits[e->op / 64] |= 1ull << (e->op % 64);
+                if (visit(&visited, bits, next)) {
+                    stack[top] = e;
+                    saved[top++] = present;
+                    present = next;
+                    lift(e);
+                    e = head->next;
+                    continue;
+                }
+                bits[e->op / 64] &= ~(1ull << (e->op % 64));
+            }
+            e = e->next;
+        } else {
+            //an operation returned before any order could place it: backtrack
+            if (top == 0) {
+                ok = 0;
+                break;
+            }
+            Event* call = stack[--top];
+            present = saved[top];
+            bits[call->op / 64] &= ~(1ull << (call->op % 64));
+            unlift(call);
+            e = call->next;
+        }
+    }
+    free(events);
+    free(call_of);
+    free(visited.bits);
+    free(visited.state);
+    free(bits);
+    free(stack);
+    free(saved);
+    return ok;
+}
 
-    free_tree(root); //frees memory from the tree
+// Records histories of random operations on CHECK_KEYS keys at 1, 2, 4, ...
+// 32 threads and checks each for linearizability; returns 1 on a violation
+int check_concurrent(void) {
+    int failed = 0;
+    printf("%8s %8s %14s\n", "threads", "ops", "linearizable");
+    HistoryOp* ops = (HistoryOp*)malloc((size_t)CONCURRENT_MAX_THREADS * CHECK_OPS * sizeof(HistoryOp));
+    HistoryOp** by_key = (HistoryOp**)malloc((size_t)CONCURRENT_MAX_THREADS * CHECK_OPS * sizeof(HistoryOp*));
+    for (int threads = 1; threads <= CONCURRENT_MAX_THREADS; threads *= 2) {
+        Set set;
+        set_init(&set, BACKEND_SKIPLIST);
+        atomic_store(&history_clock, 0);
+        HistoryTask tasks[CONCURRENT_MAX_THREADS];
+        pthread_t ids[CONCURRENT_MAX_THREADS];
+        for (int t = 0; t < threads; t++) {
+            tasks[t] = (HistoryTask){ &set, ops + (size_t)t * CHECK_OPS, 0x9E3779B97F4A7C15ull * (t + 1) };
+            pthread_create(&ids[t], NULL, record_history, &tasks[t]);
+        }
+        for (int t = 0; t < threads; t++) pthread_join(ids[t], NULL);
+        set_free(&set);
+
+        long total = (long)threads * CHECK_OPS;
+        int ok = 1;
+        for (int key = 0; key < CHECK_KEYS && ok; key++) {
+            int m = 0;
+            for (long i = 0; i < total; i++) {
+                if (ops[i].value == key) by_key[m++] = &ops[i];
+            }
+            ok = linearizable_key(by_key, m);
+        }
+        printf("%8d %8ld %14s\n", threads, total, ok ? "yes" : "NO");
+        failed |= !ok;
+    }
+    free(ops);
+    free(by_key);
+    return failed;
+}
+
+static void usage(const char* prog) {
+    fprintf(stderr, "Usage: %s [--backend avl|btree|skiplist] < commands\n", prog);
+    fprintf(stderr, "       %s --bench [max_keys]\n", prog);
+    fprintf(stderr, "       %s --bench-concurrent [commands_file]\n", prog);
+    fprintf(stderr, "       %s --check-concurrent\n", prog);
+    fprintf(stderr, "The p command prints the keys as the balanced BST over them, the same for every backend\n");
+}
+
+int main(int argc, char* argv[]) {
+    Backend backend = BACKEND_AVL;
+    for (int argi = 1; argi < argc; argi++) {
+        if (strcmp(argv[argi], "--backend") == 0 && argi + 1 < argc) {
+            argi++;
+            if (strcmp(argv[argi], "avl") == 0) {
+                backend = BACKEND_AVL;
+            } else if (strcmp(argv[argi], "btree") == 0) {
+                backend = BACKEND_BTREE;
+            } else if (strcmp(argv[argi], "skiplist") == 0) {
+                backend = BACKEND_SKIPLIST;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[argi], "--bench") == 0) {
+            benchmark_lookup(argi + 1 < argc ? atol(argv[argi + 1]) : 10000000);
+            return 0;
+        } else if (strcmp(argv[argi], "--bench-concurrent") == 0) {
+            return benchmark_concurrent(argi + 1 < argc ? argv[argi + 1] : NULL);
+        } else if (strcmp(argv[argi], "--check-concurrent") == 0) {
+            return check_concurrent();
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    Set set;
+    set_init(&set, backend);
+    CommandReader reader;
+    open_reader(&reader, STDIN_FILENO);
+    Command batch[BATCH_SIZE];
+    for (int stop = 0; !stop; ) {
+        int count = read_batch(&reader, batch, &stop);
+        run_batch(&set, batch, count);
+    }
+    flush_output();
+    close_reader(&reader);
+
+    set_free(&set); //frees memory from the tree
     return 0;
-}
\ No newline at end of file
+}
@@ -1,145 +1,1156 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <time.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
 
-// Function to allocate memory for a matrix
-double** allocateMatrix(int rows, int cols) {
-    double** M = (double**)malloc(rows * sizeof(double*));
-    for (int i = 0; i < rows; i++) {
-        M[i] = (double*)malloc(cols * sizeof(double));
-    }
+#define MATRIX_ALIGN 64
+#define TILE_COLS 8
+#define BLOCK_ROWS 64
+#define BLOCK_COLS 256
+#define BLOCK_DEPTH 256
+#define ROW_BLOCK 256
+#define CHOLESKY_BLOCK 64
+#define CHUNK_BYTES (1 << 20)
+#define CHUNK_SLOTS 2
+#define READ_BLOCK (1 << 20) // buffer for inputs that cannot be mapped
+#define READ_MARGIN 4096 // longest token guaranteed to be read whole from such inputs
+
+// Row-major matrix stored in a single aligned allocation. Rows are padded to a
+// multiple of TILE_COLS doubles and the padding is kept zero.
+typedef struct {
+    int rows;
+    int cols;
+    int stride;
+    double* data;
+} Matrix;
+
+#define ELEM(M, i, j) ((M)->data[(size_t)(i) * (M)->stride + (j)])
+
+// Function to allocate a zeroed matrix; header and elements share one block
+Matrix* allocateMatrix(int rows, int cols) {
+    int stride = (cols + TILE_COLS - 1) / TILE_COLS * TILE_COLS;
+    size_t header = (sizeof(Matrix) + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+    size_t bytes = header + (size_t)rows * stride * sizeof(double);
+    bytes = (bytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+
+    Matrix* M = aligned_alloc(MATRIX_ALIGN, bytes);
+    if (!M) return NULL;
+    memset(M, 0, bytes);
+    M->rows = rows;
+    M->cols = cols;
+    M->stride = stride;
+    M->data = (double*)((char*)M + header);
     return M;
 }
 
 // Function to free allocated memory for a matrix
-void freeMatrix(double** M, int rows) {
-    for (int i = 0; i < rows; i++) {
-        free(M[i]);
-    }
+void freeMatrix(Matrix* M) {
     free(M);
 }
 
-// Function to transpose a matrix
-double** transposeMatrix(double** M, int rows, int cols) {
-    double** transposeM = allocateMatrix(cols, rows);
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            transposeM[j][i] = M[i][j];
+// Register tile: C[0..rows) x [0..TILE_COLS) += A[0..rows) x [0..depth) * B[0..depth) x [0..TILE_COLS).
+// Products are added in increasing depth order, the same order as the textbook triple loop.
+static void multiplyTile(int rows, int depth, const double* A, int lda,
+                         const double* B, int ldb, double* C, int ldc) {
+#ifdef __AVX__
+    if (rows == 4) {
+        __m256d c00 = _mm256_load_pd(C), c01 = _mm256_load_pd(C + 4);
+        __m256d c10 = _mm256_load_pd(C + ldc), c11 = _mm256_load_pd(C + ldc + 4);
+        __m256d c20 = _mm256_load_pd(C + 2 * ldc), c21 = _mm256_load_pd(C + 2 * ldc + 4);
+        __m256d c30 = _mm256_load_pd(C + 3 * ldc), c31 = _mm256_load_pd(C + 3 * ldc + 4);
+        for (int p = 0; p < depth; p++) {
+            __m256d b0 = _mm256_load_pd(B + (size_t)p * ldb);
+            __m256d b1 = _mm256_load_pd(B + (size_t)p * ldb + 4);
+            __m256d a = _mm256_broadcast_sd(A + p);
+            c00 = _mm256_add_pd(c00, _mm256_mul_pd(a, b0));
+            c01 = _mm256_add_pd(c01, _mm256_mul_pd(a, b1));
+            a = _mm256_broadcast_sd(A + lda + p);
+            c10 = _mm256_add_pd(c10, _mm256_mul_pd(a, b0));
+            c11 = _mm256_add_pd(c11, _mm256_mul_pd(a, b1));
+            a = _mm256_broadcast_sd(A + 2 * lda + p);
+            c20 = _mm256_add_pd(c20, _mm256_mul_pd(a, b0));
+            c21 = _mm256_add_pd(c21, _mm256_mul_pd(a, b1));
+            a = _mm256_broadcast_sd(A + 3 * lda + p);
+            c30 = _mm256_add_pd(c30, _mm256_mul_pd(a, b0));
+            c31 = _mm256_add_pd(c31, _mm256_mul_pd(a, b1));
+        }
+        _mm256_store_pd(C, c00); _mm256_store_pd(C + 4, c01);
+        _mm256_store_pd(C + ldc, c10); _mm256_store_pd(C + ldc + 4, c11);
+        _mm256_store_pd(C + 2 * ldc, c20); _mm256_store_pd(C + 2 * ldc + 4, c21);
+        _mm256_store_pd(C + 3 * ldc, c30); _mm256_store_pd(C + 3 * ldc + 4, c31);
+        return;
+    }
+#endif
+    for (int r = 0; r < rows; r++) {
+        double acc[TILE_COLS];
+        for (int j = 0; j < TILE_COLS; j++) acc[j] = C[(size_t)r * ldc + j];
+        for (int p = 0; p < depth; p++) {
+            double a = A[(size_t)r * lda + p];
+            const double* b = B + (size_t)p * ldb;
+            for (int j = 0; j < TILE_COLS; j++) acc[j] += a * b[j];
         }
+        for (int j = 0; j < TILE_COLS; j++) C[(size_t)r * ldc + j] = acc[j];
     }
-    return transposeM;
 }
 
-// Function to multiply two matrices
-double** multiplyMatrices(double** A, int A_rows, int A_cols, double** B, int B_rows, int B_cols) {
-    if (A_cols != B_rows) return NULL;
-    double** result = allocateMatrix(A_rows, B_cols);
-    for (int i = 0; i < A_rows; i++) {
-        for (int j = 0; j < B_cols; j++) {
-            result[i][j] = 0;
-            for (int k = 0; k < A_cols; k++) {
-                result[i][j] += A[i][k] * B[k][j];
+// Function to multiply two matrices with a cache-blocked i-k-j kernel. Training
+// now accumulates X^T X directly, so only benchmarkMultiply (--bench-gemm) uses it.
+Matrix* multiplyMatrices(const Matrix* A, const Matrix* B) {
+    if (A->cols != B->rows) return NULL;
+    Matrix* result = allocateMatrix(A->rows, B->cols);
+    if (!result) return NULL;
+
+    for (int kk = 0; kk < A->cols; kk += BLOCK_DEPTH) {
+        int depth = A->cols - kk < BLOCK_DEPTH ? A->cols - kk : BLOCK_DEPTH;
+        for (int jj = 0; jj < B->cols; jj += BLOCK_COLS) {
+            int jEnd = jj + BLOCK_COLS < B->cols ? jj + BLOCK_COLS : B->cols;
+            for (int ii = 0; ii < A->rows; ii += BLOCK_ROWS) {
+                int iEnd = ii + BLOCK_ROWS < A->rows ? ii + BLOCK_ROWS : A->rows;
+                for (int j = jj; j < jEnd; j += TILE_COLS) {
+                    for (int i = ii; i < iEnd; i += 4) {
+                        int rows = iEnd - i < 4 ? iEnd - i : 4;
+                        multiplyTile(rows, depth, &ELEM(A, i, kk), A->stride,
+                                     &ELEM(B, kk, j), B->stride, &ELEM(result, i, j), result->stride);
+                    }
+                }
             }
         }
     }
     return result;
 }
 
-// Function to invert a matrix using Gauss-Jordan elimination
-int invertMatrix(double** M, int n) {
-    double** I = allocateMatrix(n, n); //allocates memory for identity matrix
-    for (int i = 0; i < n; i++) { //traverses row for matrix
-        for (int j = 0; j < n; j++) { //traverses column for matrix
-            I[i][j] = (i == j) ? 1.0 : 0.0; //sets up and initializes the inverse matrix to be the identity matrix.
+// Function to make an independent copy of a matrix
+Matrix* copyMatrix(const Matrix* M) {
+    Matrix* C = allocateMatrix(M->rows, M->cols);
+    memcpy(C->data, M->data, (size_t)M->rows * M->stride * sizeof(double));
+    return C;
+}
+
+static double dot(const double* a, const double* b, int n) {
+    double sum = 0;
+    for (int p = 0; p < n; p++) sum += a[p] * b[p];
+    return sum;
+}
+
+// Factors the symmetric positive definite A = L L^T in place, leaving L in the
+// lower triangle. Right-looking and blocked: each CHOLESKY_BLOCK-wide column
+// panel is factored, then subtracted from the trailing matrix in one sweep.
+// Returns 0 when a pivot collapses relative to its original diagonal entry,
+// i.e. the matrix is singular or too ill-conditioned for this method.
+int choleskyFactor(Matrix* A) {
+    int n = A->rows;
+    double* diagonal = malloc(n * sizeof(double)); //trailing updates overwrite it before its pivot is reached
+    for (int j = 0; j < n; j++) diagonal[j] = ELEM(A, j, j);
+    for (int jb = 0; jb < n; jb += CHOLESKY_BLOCK) {
+        int jEnd = jb + CHOLESKY_BLOCK < n ? jb + CHOLESKY_BLOCK : n;
+
+        // Diagonal block and the panel below it, using only this block's columns
+        for (int j = jb; j < jEnd; j++) {
+            double* Lj = &ELEM(A, j, jb);
+            double d = ELEM(A, j, j) - dot(Lj, Lj, j - jb);
+            if (!(d > diagonal[j] * 1e-12)) {
+                free(diagonal);
+                return 0;
+            }
+            ELEM(A, j, j) = sqrt(d);
+            for (int i = j + 1; i < n; i++) {
+                ELEM(A, i, j) = (ELEM(A, i, j) - dot(&ELEM(A, i, jb), Lj, j - jb)) / ELEM(A, j, j);
+            }
+        }
+
+        // Trailing update A22 -= L21 L21^T (lower triangle only)
+        for (int i = jEnd; i < n; i++) {
+            const double* Li = &ELEM(A, i, jb);
+            for (int j = jEnd; j <= i; j++) {
+                ELEM(A, i, j) -= dot(Li, &ELEM(A, j, jb), jEnd - jb);
+            }
         }
     }
-    
-    for (int p = 0; p < n; p++) {
-        double f = M[p][p]; //pivot value
-        if (f == 0) return 0; //if pivot is 0, return 0
-        for (int j = 0; j < n; j++) { //traverses the matrix array of size n
-            M[p][j] /= f; //divides the pivot row by the pivot value for the original matrix
-            I[p][j] /= f; //divides the pivot row by the pivot vlue for the identity matrix
+    free(diagonal);
+    return 1;
+}
+
+// Solves L L^T x = b by forward then back substitution, overwriting b with x
+void choleskySolve(const Matrix* L, Matrix* b) {
+    int n = L->rows;
+    for (int i = 0; i < n; i++) {
+        double sum = ELEM(b, i, 0);
+        for (int p = 0; p < i; p++) sum -= ELEM(L, i, p) * ELEM(b, p, 0);
+        ELEM(b, i, 0) = sum / ELEM(L, i, i);
+    }
+    for (int i = n - 1; i >= 0; i--) {
+        double sum = ELEM(b, i, 0);
+        for (int p = i + 1; p < n; p++) sum -= ELEM(L, p, i) * ELEM(b, p, 0);
+        ELEM(b, i, 0) = sum / ELEM(L, i, i);
+    }
+}
+
+// Solves A x = b with Householder QR, overwriting A with R and b with x.
+// Returns 0 if R is numerically rank deficient.
+int qrSolve(Matrix* A, Matrix* b) {
+    int n = A->rows;
+    double* v = malloc(n * sizeof(double));
+    double* s = malloc((n + 1) * sizeof(double));
+
+    for (int j = 0; j < n; j++) {
+        double norm = 0;
+        for (int i = j; i < n; i++) norm += ELEM(A, i, j) * ELEM(A, i, j);
+        norm = sqrt(norm);
+        if (norm == 0) continue;
+
+        // Reflector v = a - alpha e1, with alpha's sign chosen to avoid cancellation
+        double alpha = ELEM(A, j, j) > 0 ? -norm : norm;
+        double vnorm = 0;
+        for (int i = j; i < n; i++) {
+            v[i] = ELEM(A, i, j) - (i == j ? alpha : 0);
+            vnorm += v[i] * v[i];
         }
-        for (int i = 0; i < n; i++) {
-            if (i != p) {
-                f = M[i][p];
-                for (int j = 0; j < n; j++) {
-                    M[i][j] -= M[p][j] * f;
-                    I[i][j] -= I[p][j] * f;
+        double tau = 2.0 / vnorm;
+
+        // Apply H = I - tau v v^T to the trailing columns and b, row by row
+        for (int c = j + 1; c <= n; c++) s[c] = 0;
+        for (int i = j; i < n; i++) {
+            for (int c = j + 1; c < n; c++) s[c] += v[i] * ELEM(A, i, c);
+            s[n] += v[i] * ELEM(b, i, 0);
+        }
+        for (int i = j; i < n; i++) {
+            double f = tau * v[i];
+            for (int c = j + 1; c < n; c++) ELEM(A, i, c) -= f * s[c];
+            ELEM(b, i, 0) -= f * s[n];
+        }
+        ELEM(A, j, j) = alpha;
+        for (int i = j + 1; i < n; i++) ELEM(A, i, j) = 0;
+    }
+    free(v);
+    free(s);
+
+    double maxDiag = 0;
+    for (int i = 0; i < n; i++) maxDiag = fmax(maxDiag, fabs(ELEM(A, i, i)));
+    for (int i = n - 1; i >= 0; i--) {
+        if (fabs(ELEM(A, i, i)) <= maxDiag * n * DBL_EPSILON) return 0;
+        double sum = ELEM(b, i, 0);
+        for (int p = i + 1; p < n; p++) sum -= ELEM(A, i, p) * ELEM(b, p, 0);
+        ELEM(b, i, 0) = sum / ELEM(A, i, i);
+    }
+    return 1;
+}
+
+// Running sums for the normal equations (X^T X) W = X^T Y. Rows are folded in as
+// they are read, so memory is O(k^2) however many training rows there are.
+// Only the upper triangle of XTX is accumulated until finishNormalEquations.
+typedef struct {
+    int cols;
+    long long rows;
+    Matrix* XTX;
+    Matrix* XTY;
+} NormalEquations;
+
+NormalEquations* createNormalEquations(int cols) {
+    NormalEquations* ne = malloc(sizeof(NormalEquations));
+    ne->cols = cols;
+    ne->rows = 0;
+    ne->XTX = allocateMatrix(cols, cols);
+    ne->XTY = allocateMatrix(cols, 1);
+    return ne;
+}
+
+void freeNormalEquations(NormalEquations* ne) {
+    freeMatrix(ne->XTX);
+    freeMatrix(ne->XTY);
+    free(ne);
+}
+
+// Folds rows 0..count of X (with targets y) into the sums. Rows are taken
+// ROW_BLOCK at a time so that row i of XTX stays hot while the block streams
+// past it; each entry still sums its products in row order.
+void accumulateRows(NormalEquations* ne, const Matrix* X, const double* y, int count) {
+    int cols = ne->cols;
+    for (int r0 = 0; r0 < count; r0 += ROW_BLOCK) {
+        int rEnd = r0 + ROW_BLOCK < count ? r0 + ROW_BLOCK : count;
+        for (int i = 0; i < cols; i++) {
+            double* xtx = &ELEM(ne->XTX, i, 0);
+            double xty = ELEM(ne->XTY, i, 0);
+            for (int r = r0; r < rEnd; r++) {
+                const double* x = &ELEM(X, r, 0);
+                double a = x[i];
+                for (int j = i; j < cols; j++) {
+                    xtx[j] += a * x[j];
                 }
+                xty += a * y[r];
+            }
+            ELEM(ne->XTY, i, 0) = xty;
+        }
+    }
+    ne->rows += count;
+}
+
+// Mirrors the accumulated upper triangle so XTX is a full symmetric matrix
+void finishNormalEquations(NormalEquations* ne) {
+    for (int i = 0; i < ne->cols; i++) {
+        for (int j = 0; j < i; j++) {
+            ELEM(ne->XTX, i, j) = ELEM(ne->XTX, j, i);
+        }
+    }
+}
+
+// Solves the normal equations for the weights without forming an inverse:
+// Cholesky first, Householder QR if the factorization breaks down.
+// Returns NULL if the system is singular.
+Matrix* solveNormalEquations(const NormalEquations* ne) {
+    Matrix* A = copyMatrix(ne->XTX);
+    Matrix* W = copyMatrix(ne->XTY);
+    if (!choleskyFactor(A)) {
+        freeMatrix(A);
+        A = copyMatrix(ne->XTX);
+        memcpy(W->data, ne->XTY->data, (size_t)W->rows * W->stride * sizeof(double));
+        if (!qrSolve(A, W)) {
+            freeMatrix(A);
+            freeMatrix(W);
+            return NULL;
+        }
+    } else {
+        choleskySolve(A, W);
+    }
+    freeMatrix(A);
+    return W;
+}
+
+// Whitespace-separated numbers read straight out of a memory-mapped file, or
+// for inputs that cannot be mapped, out of one reused READ_BLOCK buffer
+typedef struct {
+    const char* cur;
+    const char* end;
+    char* base;
+    size_t size;
+    int mapped;
+    int streamed; // more of the input is still to be read from fd into base
+    int fd;
+} NumberReader;
+
+// Maps path for reading; files that cannot be mapped (pipes, empty files) are
+// streamed through a fixed buffer, so memory stays bounded either way
+int openNumberReader(NumberReader* r, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    r->mapped = 0;
+    r->streamed = 0;
+    r->base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        r->base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        r->size = st.st_size;
+    }
+    if (r->base != MAP_FAILED) {
+        r->mapped = 1;
+        posix_madvise(r->base, r->size, POSIX_MADV_SEQUENTIAL);
+        close(fd);
+    } else {
+        r->base = malloc(READ_BLOCK);
+        r->size = 0;
+        r->streamed = 1;
+        r->fd = fd;
+    }
+    r->cur = r->base;
+    r->end = r->base + r->size;
+    return 1;
+}
+
+void closeNumberReader(NumberReader* r) {
+    if (r->mapped) munmap(r->base, r->size);
+    else free(r->base);
+    if (r->streamed) close(r->fd);
+}
+
+static inline int isBlank(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+// Moves the unread tail (possibly a partial number) to the front of the buffer
+// and fills the rest; at end of input the reader stops streaming
+static void refillNumberReader(NumberReader* r) {
+    size_t filled = r->end - r->cur;
+    memmove(r->base, r->cur, filled);
+    while (filled < READ_BLOCK) {
+        ssize_t got = read(r->fd, r->base + filled, READ_BLOCK - filled);
+        if (got <= 0) {
+            close(r->fd);
+            r->streamed = 0;
+            break;
+        }
+        filled += got;
+    }
+    r->cur = r->base;
+    r->end = r->base + filled;
+}
+
+// Skips blanks and makes sure the next token is in the buffer whole (tokens of
+// up to READ_MARGIN bytes)
+static inline void fillToken(NumberReader* r) {
+    while (r->streamed) {
+        while (r->cur < r->end && isBlank(*r->cur)) r->cur++;
+        if (r->end - r->cur >= READ_MARGIN) return;
+        refillNumberReader(r);
+    }
+}
+
+// Skips one whitespace-delimited token, such as the "train"/"data" header
+void skipToken(NumberReader* r) {
+    fillToken(r);
+    while (r->cur < r->end && isBlank(*r->cur)) r->cur++;
+    while (r->cur < r->end && !isBlank(*r->cur)) r->cur++;
+}
+
+// Reads the next number as a correctly rounded double. Plain decimals with at
+// most 19 significant digits whose mantissa fits in 53 bits and whose decimal
+// exponent is within +-22 are converted exactly with one multiply or divide
+// (Clinger's fast path); anything else goes through strtod.
+int readNumber(NumberReader* r, double* out) {
+    static const double pow10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    fillToken(r);
+    const char* p = r->cur;
+    const char* end = r->end;
+    while (p < end && isBlank(*p)) p++;
+    if (p == end) {
+        r->cur = p;
+        return 0;
+    }
+    const char* start = p;
+
+    int negative = 0;
+    if (*p == '-' || *p == '+') negative = *p++ == '-';
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0, sawDigit = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; p++, sawDigit = 1) {
+        if (mantissa || *p != '0') {
+            if (digits++ < 19) mantissa = mantissa * 10 + (*p - '0');
+            else exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, sawDigit = 1) {
+            if (mantissa || *p != '0') {
+                if (digits++ < 19) {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    exponent--;
+                }
+            } else {
+                exponent--;
+            }
+        }
+    }
+    if (sawDigit && p < end && (*p == 'e' || *p == 'E')) {
+        const char* q = p + 1;
+        int expNegative = 0, expValue = 0;
+        if (q < end && (*q == '-' || *q == '+')) expNegative = *q++ == '-';
+        if (q < end && *q >= '0' && *q <= '9') {
+            for (; q < end && *q >= '0' && *q <= '9'; q++) {
+                if (expValue < 100000) expValue = expValue * 10 + (*q - '0');
+            }
+            exponent += expNegative ? -expValue : expValue;
+            p = q;
+        }
+    }
+
+    int delimited = p == end || isBlank(*p);
+    if (sawDigit && delimited && digits <= 19 && mantissa <= (1ULL << 53) &&
+        exponent >= -22 && exponent <= 22) {
+        double value = (double)mantissa;
+        value = exponent < 0 ? value / pow10[-exponent] : value * pow10[exponent];
+        *out = negative ? -value : value;
+        r->cur = p;
+        return 1;
+    }
+
+    // Slow path: hand a NUL-terminated copy of the token to strtod
+    const char* tokEnd = start;
+    while (tokEnd < end && !isBlank(*tokEnd)) tokEnd++;
+    size_t len = tokEnd - start;
+    char small[64];
+    char* copy = len < sizeof(small) ? small : malloc(len + 1);
+    memcpy(copy, start, len);
+    copy[len] = '\0';
+    char* stop;
+    *out = strtod(copy, &stop);
+    int ok = stop != copy;
+    r->cur = start + (stop - copy);
+    if (copy != small) free(copy);
+    return ok;
+}
+
+int readCount(NumberReader* r, int* out) {
+    double value;
+    if (!readNumber(r, &value)) return 0;
+    *out = (int)value;
+    return 1;
+}
+
+// Row counts can pass 2^31 for narrow k; rejects anything that is not a whole
+// number in [0, 2^63)
+int readCount64(NumberReader* r, long long* out) {
+    double value;
+    if (!readNumber(r, &value)) return 0;
+    if (!(value >= 0 && value < 9223372036854775808.0) || value != floor(value)) return 0;
+    *out = (long long)value;
+    return 1;
+}
+
+// Reads up to maxRows training rows (k features then the target) into X and Y
+int readTrainingRows(NumberReader* reader, Matrix* X, double* Y, int k, int maxRows) {
+    int rows = 0;
+    for (; rows < maxRows; rows++) {
+        ELEM(X, rows, 0) = 1.0; //sets the first column of matrix X to 1
+        for (int j = 1; j <= k; j++) {
+            if (!readNumber(reader, &ELEM(X, rows, j))) return rows;
+        }
+        if (!readNumber(reader, &Y[rows])) return rows;
+    }
+    return rows;
+}
+
+// Merges src's sums into dst; both must still hold upper-triangle sums only
+void mergeNormalEquations(NormalEquations* dst, const NormalEquations* src) {
+    for (int i = 0; i < dst->cols; i++) {
+        for (int j = i; j < dst->cols; j++) {
+            ELEM(dst->XTX, i, j) += ELEM(src->XTX, i, j);
+        }
+        ELEM(dst->XTY, i, 0) += ELEM(src->XTY, i, 0);
+    }
+    dst->rows += src->rows;
+}
+
+// Training rows parsed in chunks by a reader thread and handed to the
+// accumulator threads through a pool of chunk buffers
+enum { CHUNK_EMPTY, CHUNK_FULL, CHUNK_BUSY };
+
+typedef struct {
+    Matrix* X;
+    double* Y;
+    int count;
+    int state;
+} RowChunk;
+
+typedef struct {
+    NumberReader* reader;
+    int k;
+    long long remaining;
+    int chunkRows;
+    RowChunk* chunks;
+    int chunkCount;
+    int done;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} TrainingStream;
+
+typedef struct {
+    TrainingStream* stream;
+    NormalEquations* sums;
+} AccumulatorWorker;
+
+static RowChunk* claimChunk(TrainingStream* ts, int from, int to) {
+    for (int s = 0; s < ts->chunkCount; s++) {
+        if (ts->chunks[s].state == from) {
+            ts->chunks[s].state = to;
+            return &ts->chunks[s];
+        }
+    }
+    return NULL;
+}
+
+static void* readTrainingChunks(void* arg) {
+    TrainingStream* ts = arg;
+    while (ts->remaining > 0) {
+        RowChunk* chunk;
+        pthread_mutex_lock(&ts->lock);
+        while (!(chunk = claimChunk(ts, CHUNK_EMPTY, CHUNK_BUSY))) pthread_cond_wait(&ts->changed, &ts->lock);
+        pthread_mutex_unlock(&ts->lock);
+
+        int want = ts->remaining < ts->chunkRows ? (int)ts->remaining : ts->chunkRows;
+        chunk->count = readTrainingRows(ts->reader, chunk->X, chunk->Y, ts->k, want);
+        ts->remaining = chunk->count < want ? 0 : ts->remaining - want;
+
+        pthread_mutex_lock(&ts->lock);
+        chunk->state = CHUNK_FULL;
+        pthread_cond_broadcast(&ts->changed);
+        pthread_mutex_unlock(&ts->lock);
+    }
+    pthread_mutex_lock(&ts->lock);
+    ts->done = 1;
+    pthread_cond_broadcast(&ts->changed);
+    pthread_mutex_unlock(&ts->lock);
+    return NULL;
+}
+
+static void* accumulateChunks(void* arg) {
+    AccumulatorWorker* worker = arg;
+    TrainingStream* ts = worker->stream;
+    for (;;) {
+        RowChunk* chunk;
+        pthread_mutex_lock(&ts->lock);
+        while (!(chunk = claimChunk(ts, CHUNK_FULL, CHUNK_BUSY)) && !ts->done) pthread_cond_wait(&ts->changed, &ts->lock);
+        pthread_mutex_unlock(&ts->lock);
+        if (!chunk) return NULL;
+
+        accumulateRows(worker->sums, chunk->X, chunk->Y, chunk->count);
+
+        pthread_mutex_lock(&ts->lock);
+        chunk->state = CHUNK_EMPTY;
+        pthread_cond_broadcast(&ts->changed);
+        pthread_mutex_unlock(&ts->lock);
+    }
+}
+
+// Streams n training rows from reader into ne, which may already hold sums from
+// earlier data. Parsing runs on its own thread ahead of `threads` accumulators;
+// the first adds straight into ne, the others into private sums merged at the
+// end. Peak memory is O(threads * k^2) plus threads + 1 chunks of about
+// CHUNK_BYTES each. Only the upper triangle of XTX is filled; trainModel
+// finishes the normal equations.
+void trainFromStream(NumberReader* reader, NormalEquations* ne, long long n, int threads) {
+    int k = ne->cols - 1;
+    TrainingStream ts = { .reader = reader, .k = k, .remaining = n };
+    ts.chunkRows = CHUNK_BYTES / (int)((k + 1) * sizeof(double));
+    if (ts.chunkRows < ROW_BLOCK) ts.chunkRows = ROW_BLOCK;
+    ts.chunkCount = threads + 1 > CHUNK_SLOTS ? threads + 1 : CHUNK_SLOTS;
+    ts.chunks = calloc(ts.chunkCount, sizeof(RowChunk));
+    for (int s = 0; s < ts.chunkCount; s++) {
+        ts.chunks[s].X = allocateMatrix(ts.chunkRows, k + 1);
+        ts.chunks[s].Y = malloc(ts.chunkRows * sizeof(double));
+    }
+    pthread_mutex_init(&ts.lock, NULL);
+    pthread_cond_init(&ts.changed, NULL);
+
+    AccumulatorWorker* workers = malloc(threads * sizeof(AccumulatorWorker));
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    pthread_t readerThread;
+    pthread_create(&readerThread, NULL, readTrainingChunks, &ts);
+    for (int t = 0; t < threads; t++) {
+        workers[t].stream = &ts;
+        workers[t].sums = t == 0 ? ne : createNormalEquations(k + 1);
+        if (t > 0) pthread_create(&ids[t], NULL, accumulateChunks, &workers[t]);
+    }
+    accumulateChunks(&workers[0]);
+    for (int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+    pthread_join(readerThread, NULL);
+
+    for (int t = 1; t < threads; t++) {
+        mergeNormalEquations(ne, workers[t].sums);
+        freeNormalEquations(workers[t].sums);
+    }
+
+    pthread_mutex_destroy(&ts.lock);
+    pthread_cond_destroy(&ts.changed);
+    for (int s = 0; s < ts.chunkCount; s++) {
+        freeMatrix(ts.chunks[s].X);
+        free(ts.chunks[s].Y);
+    }
+    free(ts.chunks);
+    free(workers);
+    free(ids);
+}
+
+// Prediction Y = X W split into contiguous row batches, one per thread
+typedef struct {
+    const Matrix* X;
+    const double* weights;
+    double* Y;
+    int first, last;
+} PredictionBatch;
+
+static void* predictBatch(void* arg) {
+    PredictionBatch* batch = arg;
+    int cols = batch->X->cols;
+    for (int i = batch->first; i < batch->last; i++) {
+        batch->Y[i] = dot(&ELEM(batch->X, i, 0), batch->weights, cols);
+    }
+    return NULL;
+}
+
+// Computes one prediction per row of X; returns a malloc'd array of X->rows values
+double* predictRows(const Matrix* X, const Matrix* W, int threads) {
+    double* Y = malloc((X->rows + 1) * sizeof(double));
+    double* weights = malloc(X->cols * sizeof(double));
+    for (int j = 0; j < X->cols; j++) weights[j] = ELEM(W, j, 0);
+
+    if (threads > X->rows / ROW_BLOCK) threads = X->rows / ROW_BLOCK;
+    if (threads < 1) threads = 1;
+    PredictionBatch* batches = malloc(threads * sizeof(PredictionBatch));
+    pthread_t* ids = malloc(threads * sizeof(pthread_t));
+    for (int t = 0; t < threads; t++) {
+        batches[t] = (PredictionBatch){ X, weights, Y,
+            (int)((long long)X->rows * t / threads), (int)((long long)X->rows * (t + 1) / threads) };
+        if (t > 0) pthread_create(&ids[t], NULL, predictBatch, &batches[t]);
+    }
+    predictBatch(&batches[0]);
+    for (int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+
+    free(batches);
+    free(ids);
+    free(weights);
+    return Y;
+}
+
+static double elapsedSeconds(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Compares the blocked multiply against the naive i-j-k loop at several sizes
+static void benchmarkMultiply() {
+    static const int sizes[] = {64, 128, 256, 512, 1024};
+    printf("%6s %12s %12s %10s %10s %12s\n", "n", "naive_ms", "blocked_ms", "naive_GF", "blocked_GF", "max_rel_err");
+    srand(211);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+        Matrix* A = allocateMatrix(n, n);
+        Matrix* B = allocateMatrix(n, n);
+        Matrix* naive = allocateMatrix(n, n);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                ELEM(A, i, j) = rand() / (double)RAND_MAX - 0.5;
+                ELEM(B, i, j) = rand() / (double)RAND_MAX - 0.5;
+            }
+        }
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                double sum = 0;
+                for (int k = 0; k < n; k++) sum += ELEM(A, i, k) * ELEM(B, k, j);
+                ELEM(naive, i, j) = sum;
+            }
+        }
+        double naiveTime = elapsedSeconds(&start);
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Matrix* blocked = multiplyMatrices(A, B);
+        double blockedTime = elapsedSeconds(&start);
+
+        double maxErr = 0;
+        for (int i = 0; i < n; i++) {
+            for (int j = 0; j < n; j++) {
+                double ref = ELEM(naive, i, j), diff = ELEM(blocked, i, j) - ref;
+                double err = (diff < 0 ? -diff : diff) / (ref < 0 ? -ref : ref > 1 ? ref : 1);
+                if (err > maxErr) maxErr = err;
+            }
+        }
+
+        double flops = 2.0 * n * n * n;
+        printf("%6d %12.2f %12.2f %10.2f %10.2f %12.2e\n", n, naiveTime * 1e3, blockedTime * 1e3,
+               flops / naiveTime * 1e-9, flops / blockedTime * 1e-9, maxErr);
+        freeMatrix(A);
+        freeMatrix(B);
+        freeMatrix(naive);
+        freeMatrix(blocked);
+    }
+}
+
+// Compares the fast reader against the old fscanf("%lf") loop on generated values
+static void benchmarkParse(long long count) {
+    char path[] = "/tmp/estimate_benchXXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return;
+    }
+    FILE* out = fdopen(fd, "w");
+    srand(211);
+    for (long long i = 0; i < count; i++) {
+        double v = rand() / (double)RAND_MAX * 1e6;
+        switch (i % 4) {
+            case 0: fprintf(out, "%.0f", v); break;
+            case 1: fprintf(out, "%.2f", v); break;
+            case 2: fprintf(out, "%.17g", v); break;
+            default: fprintf(out, "%.3e", v); break;
+        }
+        fputc(i % 8 == 7 ? '\n' : ' ', out);
+    }
+    fclose(out);
+
+    double* slow = malloc(count * sizeof(double));
+    double* fast = malloc(count * sizeof(double));
+    struct timespec start;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE* in = fopen(path, "r");
+    long long slowCount = 0;
+    while (slowCount < count && fscanf(in, "%lf", &slow[slowCount]) == 1) slowCount++;
+    fclose(in);
+    double slowTime = elapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    NumberReader reader;
+    openNumberReader(&reader, path);
+    size_t bytes = reader.size;
+    long long fastCount = 0;
+    while (fastCount < count && readNumber(&reader, &fast[fastCount])) fastCount++;
+    closeNumberReader(&reader);
+    double fastTime = elapsedSeconds(&start);
+
+    long long mismatches = slowCount != fastCount;
+    for (long long i = 0; i < slowCount && i < fastCount; i++) {
+        if (memcmp(&slow[i], &fast[i], sizeof(double)) != 0) mismatches++;
+    }
+    printf("%lld values, %.1f MB\n", count, bytes / 1e6);
+    printf("fscanf:      %8.1f ms %8.1f MB/s\n", slowTime * 1e3, bytes / slowTime / 1e6);
+    printf("readNumber:  %8.1f ms %8.1f MB/s\n", fastTime * 1e3, bytes / fastTime / 1e6);
+    printf("mismatches:  %lld\n", mismatches);
+
+    free(slow);
+    free(fast);
+    unlink(path);
+}
+
+// Model files hold the magic "ESTM", a format version, the feature count k
+// and the k + 1 weights of W as native-endian doubles
+#define MODEL_MAGIC "ESTM"
+#define MODEL_VERSION 1
+#define MODEL_MAX_K (1 << 24) // sanity limit on k when loading
+
+int saveModel(const char* path, const Matrix* W) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return 0;
+    int header[2] = { MODEL_VERSION, W->rows - 1 };
+    int ok = fwrite(MODEL_MAGIC, 1, 4, file) == 4 && fwrite(header, sizeof(int), 2, file) == 2;
+    for (int j = 0; ok && j < W->rows; j++) {
+        ok = fwrite(&ELEM(W, j, 0), sizeof(double), 1, file) == 1;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// Returns the (k + 1) x 1 weight matrix, or NULL if path is not a valid model file
+Matrix* loadModel(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    char magic[4];
+    int header[2];
+    Matrix* W = NULL;
+    struct stat st;
+    // k is bounded by the weights the file actually holds, so a corrupt header
+    // cannot ask for a huge allocation
+    long long weights = fstat(fileno(file), &st) == 0 && st.st_size > 12 ? (st.st_size - 12) / (long long)sizeof(double) : 0;
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, MODEL_MAGIC, 4) == 0 &&
+        fread(header, sizeof(int), 2, file) == 2 && header[0] == MODEL_VERSION && header[1] >= 0 &&
+        header[1] < MODEL_MAX_K && header[1] + 1LL <= weights && (W = allocateMatrix(header[1] + 1, 1))) {
+        for (int j = 0; j < W->rows; j++) {
+            if (fread(&ELEM(W, j, 0), sizeof(double), 1, file) != 1) {
+                freeMatrix(W);
+                W = NULL;
+                break;
             }
         }
     }
-    
+    fclose(file);
+    return W;
+}
+
+// Accumulator state files hold the magic "ESTS", a format version, k, the
+// number of rows seen, the upper triangle of X^T X row by row, then X^T Y
+#define STATE_MAGIC "ESTS"
+#define STATE_VERSION 1
+
+int saveNormalEquations(const char* path, const NormalEquations* ne) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return 0;
+    int header[2] = { STATE_VERSION, ne->cols - 1 };
+    int ok = fwrite(STATE_MAGIC, 1, 4, file) == 4 && fwrite(header, sizeof(int), 2, file) == 2 &&
+             fwrite(&ne->rows, sizeof(long long), 1, file) == 1;
+    for (int i = 0; ok && i < ne->cols; i++) {
+        ok = fwrite(&ELEM(ne->XTX, i, i), sizeof(double), ne->cols - i, file) == (size_t)(ne->cols - i);
+    }
+    for (int i = 0; ok && i < ne->cols; i++) {
+        ok = fwrite(&ELEM(ne->XTY, i, 0), sizeof(double), 1, file) == 1;
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// Returns the saved accumulators (upper triangle only), or NULL if path is not a valid state file
+NormalEquations* loadNormalEquations(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    char magic[4];
+    int header[2];
+    NormalEquations* ne = NULL;
+    if (fread(magic, 1, 4, file) == 4 && memcmp(magic, STATE_MAGIC, 4) == 0 &&
+        fread(header, sizeof(int), 2, file) == 2 && header[0] == STATE_VERSION && header[1] >= 0) {
+        ne = createNormalEquations(header[1] + 1);
+        int ok = fread(&ne->rows, sizeof(long long), 1, file) == 1;
+        for (int i = 0; ok && i < ne->cols; i++) {
+            ok = fread(&ELEM(ne->XTX, i, i), sizeof(double), ne->cols - i, file) == (size_t)(ne->cols - i);
+        }
+        for (int i = 0; ok && i < ne->cols; i++) {
+            ok = fread(&ELEM(ne->XTY, i, 0), sizeof(double), 1, file) == 1;
+        }
+        if (!ok) {
+            freeNormalEquations(ne);
+            ne = NULL;
+        }
+    }
+    fclose(file);
+    return ne;
+}
+
+// Folds a "train" file into prior (or into fresh sums when prior is NULL) and
+// returns the finished normal equations, or NULL if the feature counts differ
+// or the row count is not a valid count
+NormalEquations* trainModel(NumberReader* train_file, NormalEquations* prior, int threads) {
+    int k = 0;
+    long long n = 0;
+    skipToken(train_file); //skips the "train" header
+    readCount(train_file, &k); //k and n are the number of attributes and houses, respectively
+    if (!readCount64(train_file, &n)) return NULL;
+    if (prior && prior->cols != k + 1) return NULL;
+    NormalEquations* ne = prior ? prior : createNormalEquations(k + 1);
+    trainFromStream(train_file, ne, n, threads); //folds the training rows into X^T X and X^T Y chunk by chunk
+    finishNormalEquations(ne);
+    return ne;
+}
+
+// Returns (X^T X)^-1 for recursive least squares, or NULL if X^T X is not safely positive definite
+Matrix* invertNormalMatrix(const NormalEquations* ne) {
+    int n = ne->cols;
+    Matrix* L = copyMatrix(ne->XTX);
+    if (!choleskyFactor(L)) {
+        freeMatrix(L);
+        return NULL;
+    }
+    Matrix* P = allocateMatrix(n, n);
+    Matrix* column = allocateMatrix(n, 1);
+    for (int c = 0; c < n; c++) {
+        for (int i = 0; i < n; i++) ELEM(column, i, 0) = i == c;
+        choleskySolve(L, column);
+        for (int i = 0; i < n; i++) ELEM(P, i, c) = ELEM(column, i, 0);
+    }
+    freeMatrix(column);
+    freeMatrix(L);
+    return P;
+}
+
+// Recursive least squares step for one new row x with target y: a Sherman-Morrison
+// update of P = (X^T X)^-1 and of W, O(k^2) instead of a fresh O(k^3) solve
+void updateOnline(Matrix* P, Matrix* W, const double* x, double y, double* Px) {
+    int n = P->rows;
+    double xPx = 0, prediction = 0;
+    for (int i = 0; i < n; i++) {
+        Px[i] = dot(&ELEM(P, i, 0), x, n);
+        xPx += x[i] * Px[i];
+        prediction += x[i] * ELEM(W, i, 0);
+    }
+    double scale = 1.0 / (1.0 + xPx);
     for (int i = 0; i < n; i++) {
+        ELEM(W, i, 0) += Px[i] * scale * (y - prediction);
         for (int j = 0; j < n; j++) {
-            M[i][j] = I[i][j];
+            ELEM(P, i, j) -= Px[i] * Px[j] * scale;
+        }
+    }
+}
+
+// Prints one prediction per row of a "data" file; returns 0 if its feature count does not match W
+int scoreDataFile(NumberReader* data_file, const Matrix* W, int threads) {
+    int k = 0, m = 0;
+    skipToken(data_file);
+    readCount(data_file, &k);
+    readCount(data_file, &m);
+    if (k + 1 != W->rows) return 0;
+
+    Matrix* X_new = allocateMatrix(m, k + 1);
+    for (int i = 0; i < m; i++) {
+        ELEM(X_new, i, 0) = 1.0;
+        for (int j = 1; j <= k; j++) {
+            readNumber(data_file, &ELEM(X_new, i, j));
+        }
+    }
+
+    double* Y_new = predictRows(X_new, W, threads);
+    for (int i = 0; i < m; i++) {
+        printf("%.0f\n", Y_new[i]);
+    }
+    freeMatrix(X_new);
+    free(Y_new);
+    return 1;
+}
+
+// Scoring server: each stdin line of k feature values gets its prediction
+// written and flushed immediately. When the accumulators are available, a line
+// of k values plus a target is a new training row: it is folded into ne and W
+// is updated in place (recursive least squares), answering "updated".
+// Blank lines are skipped; every other line that does not parse gets "error".
+void serveModel(Matrix* W, NormalEquations* ne) {
+    int cols = W->rows;
+    double* weights = malloc(cols * sizeof(double));
+    double* Px = malloc(cols * sizeof(double));
+    Matrix* row = allocateMatrix(1, cols);
+    double* x = &ELEM(row, 0, 0);
+    x[0] = 1.0;
+    Matrix* P = ne ? invertNormalMatrix(ne) : NULL;
+
+    char* line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, stdin)) > 0) {
+        const char* p = line;
+        while (p < line + len && isBlank(*p)) p++;
+        if (p == line + len) continue; //blank line
+
+        NumberReader reader = { .cur = p, .end = line + len };
+        int j = 1;
+        while (j < cols && readNumber(&reader, &x[j])) j++;
+        double y;
+        int hasTarget = j == cols && readNumber(&reader, &y);
+        while (reader.cur < reader.end && isBlank(*reader.cur)) reader.cur++; //anything left did not parse
+
+        if (j < cols || reader.cur < reader.end || (hasTarget && !ne)) {
+            printf("error\n");
+        } else if (hasTarget) {
+            accumulateRows(ne, row, &y, 1);
+            if (P) {
+                updateOnline(P, W, x, y, Px);
+            } else {
+                finishNormalEquations(ne);
+                Matrix* solved = solveNormalEquations(ne);
+                if (solved) {
+                    memcpy(W->data, solved->data, (size_t)W->rows * W->stride * sizeof(double));
+                    freeMatrix(solved);
+                    P = invertNormalMatrix(ne);
+                }
+            }
+            printf("updated\n");
+        } else {
+            for (int i = 0; i < cols; i++) weights[i] = ELEM(W, i, 0);
+            printf("%.0f\n", dot(x, weights, cols));
         }
+        fflush(stdout);
     }
-    freeMatrix(I, n); //frees up allocated memory for the inverse matrix
-    return 1; //returns 1 if the matrix is successfully inverted
+    if (ne) finishNormalEquations(ne);
+    free(line);
+    free(weights);
+    free(Px);
+    freeMatrix(row);
+    if (P) freeMatrix(P);
+}
+
+static void usage(const char* prog) {
+    printf("Usage: %s [--threads N] [--state <state_file>] [--save-state <state_file>]\n"
+           "          [--save-model <model_file>] [--serve] <train_file> [<data_file>]\n", prog);
+    printf("       %s [--threads N] --model <model_file> <data_file>\n", prog);
+    printf("       %s --model <model_file> --serve\n", prog);
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <train_file> <data_file>\n", argv[0]);
+    if (argc == 2 && strcmp(argv[1], "--bench-gemm") == 0) {
+        benchmarkMultiply();
+        return 0;
+    }
+    if (argc >= 2 && strcmp(argv[1], "--bench-parse") == 0) {
+        benchmarkParse(argc > 2 ? atoll(argv[2]) : 10000000);
+        return 0;
+    }
+
+    int threads = 1, serve = 0;
+    const char* modelIn = NULL;
+    const char* modelOut = NULL;
+    const char* stateIn = NULL;
+    const char* stateOut = NULL;
+    int argi = 1;
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+        if (strcmp(argv[argi], "--threads") == 0 && argi + 1 < argc) {
+            threads = atoi(argv[++argi]);
+            if (threads < 1) threads = 1;
+        } else if (strcmp(argv[argi], "--model") == 0 && argi + 1 < argc) {
+            modelIn = argv[++argi];
+        } else if (strcmp(argv[argi], "--save-model") == 0 && argi + 1 < argc) {
+            modelOut = argv[++argi];
+        } else if (strcmp(argv[argi], "--state") == 0 && argi + 1 < argc) {
+            stateIn = argv[++argi];
+        } else if (strcmp(argv[argi], "--save-state") == 0 && argi + 1 < argc) {
+            stateOut = argv[++argi];
+        } else if (strcmp(argv[argi], "--serve") == 0) {
+            serve = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    int positional = argc - argi;
+    int valid = modelIn ? !modelOut && !stateIn && !stateOut && positional == (serve ? 0 : 1)
+                        : serve ? positional == 1
+                                : positional == 2 || (positional == 1 && (modelOut || stateOut));
+    if (!valid) {
+        usage(argv[0]);
         return 1;
     }
-    
-    FILE* train_file = fopen(argv[1], "r"); //opens the training data file
-    FILE* data_file = fopen(argv[2], "r"); //opens the input data file
-    if (!train_file || !data_file) { //if either one of these files cannot be found, it returns an error
+
+    NumberReader train_file, data_file;
+    const char* dataPath = modelIn ? (serve ? NULL : argv[argi]) : positional == 2 ? argv[argi + 1] : NULL;
+    if (!modelIn && !openNumberReader(&train_file, argv[argi])) { //opens the training data file
         printf("error\n");
         return 1;
     }
-    
-    int k, n;
-    fscanf(train_file, "train\n%d\n%d\n", &k, &n); //k and n are the number of attributes and houses, respectively
-    double** X = allocateMatrix(n, k + 1); //allocates memory for matrix X
-    double** Y = allocateMatrix(n, 1); //allocates memory for matrix Y
-    for (int i = 0; i < n; i++) {
-        X[i][0] = 1.0; //sets the first column of matrix X to 1
-        for (int j = 1; j <= k; j++) {
-            fscanf(train_file, "%lf", &X[i][j]);
+    if (dataPath && !openNumberReader(&data_file, dataPath)) { //opens the input data file
+        printf("error\n");
+        return 1;
+    }
+
+    Matrix* W = NULL;
+    NormalEquations* ne = NULL;
+    if (modelIn) {
+        W = loadModel(modelIn);
+    } else {
+        NormalEquations* prior = NULL;
+        if (stateIn && !(prior = loadNormalEquations(stateIn))) {
+            printf("error\n");
+            return 1;
         }
-        fscanf(train_file, "%lf", &Y[i][0]);
+        ne = trainModel(&train_file, prior, threads); //appends the new rows to any saved accumulators
+        closeNumberReader(&train_file);
+        if (ne) W = solveNormalEquations(ne); //solves (X^T X) W = X^T Y
     }
-    fclose(train_file);
-    
-    double** XT = transposeMatrix(X, n, k + 1); //takes the transpose of matrix X
-    double** XTX = multiplyMatrices(XT, k + 1, n, X, n, k + 1); //multiplies matrix X with transpose of matrix X
-    double** XTY = multiplyMatrices(XT, k + 1, n, Y, n, 1); //multiplies matrix Y with transpose of matrix X
-    
-    if (!invertMatrix(XTX, k + 1)) {
+    if (!W && ne) {
+        //too few rows to solve yet: the accumulators are still saved so the next batch can extend them
+        int saved = stateOut && saveNormalEquations(stateOut, ne);
+        fprintf(stderr, "Singular normal equations%s\n", saved ? "; state saved" : "");
+        freeNormalEquations(ne);
         printf("error\n");
         return 1;
     }
-    
-    double** W = multiplyMatrices(XTX, k + 1, k + 1, XTY, k + 1, 1); //calculates matrix W = (XTX)^-1 * XTY
-    
-    int m;
-    fscanf(data_file, "data\n%d\n%d\n", &k, &m);
-    double** X_new = allocateMatrix(m, k + 1);
-    for (int i = 0; i < m; i++) {
-        X_new[i][0] = 1.0;
-        for (int j = 1; j <= k; j++) {
-            fscanf(data_file, "%lf", &X_new[i][j]);
-        }
+    if (!W) {
+        printf("error\n");
+        return 1;
     }
-    fclose(data_file);
-    
-    double** Y_new = multiplyMatrices(X_new, m, k + 1, W, k + 1, 1);
-    for (int i = 0; i < m; i++) {
-        printf("%.0f\n", Y_new[i][0]);
-    }
-    
-    freeMatrix(X, n);
-    freeMatrix(Y, n);
-    freeMatrix(XT, k + 1);
-    freeMatrix(XTX, k + 1);
-    freeMatrix(XTY, k + 1);
-    freeMatrix(W, k + 1);
-    freeMatrix(X_new, m);
-    freeMatrix(Y_new, m);
-    return 0;
-}
\ No newline at end of file
+    if (modelOut && !saveModel(modelOut, W)) {
+        printf("error\n");
+        return 1;
+    }
+
+    int ok = 1;
+    if (serve) {
+        serveModel(W, ne);
+    } else if (dataPath) {
+        ok = scoreDataFile(&data_file, W, threads);
+        closeNumberReader(&data_file);
+        if (!ok) printf("error\n");
+    }
+    if (stateOut && !saveNormalEquations(stateOut, ne)) {
+        printf("error\n");
+        ok = 0;
+    }
+
+    freeMatrix(W);
+    if (ne) freeNormalEquations(ne);
+    return ok ? 0 : 1;
+}
@@ -1,125 +1,304 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 
-typedef struct Node {
-    int data;
-    struct Node* next;
-} Node;
-
-//create a new node
-Node* create_newnode(int value) {
-    Node* new_node = (Node*)malloc(sizeof(Node));
-    new_node->data = value;
-    new_node->next = NULL;
-    return new_node;
-}
- 
-//insert a new value in sorted order without duplicates
-Node* insert(Node* head, int value) {
-    Node* newNode = create_newnode(value);
-    if (!newNode) return head; // Memory allocation failure
-
-    // If list is empty or new node should be the new head
-    if (!head || value < head->data) {
-        newNode->next = head;
-       // printf("new list %d",newNode->data);
-        return newNode;
-    }
-    
-    Node* current = head;
-    while (current->next && current->next->data < value) {
-        current = current->next;
+#define MAX_LEVEL 32
+#define HEAD 0 // the sentinel is always the first node in the arena
+#define NIL 0  // so index 0 can double as the null link
+
+// Indexable skip list: every forward link also records how many nodes it
+// passes over (span) and how many bytes of printed text those nodes take
+// (bytes), so an insert or delete finds both its position and its place in
+// the printed line in O(log n).
+//
+// Nodes live in one growable arena of 16-byte cells and refer to each other
+// by 32-bit index. A node of level L is a header cell followed by its L link
+// cells; freed runs are kept on one free list per level and reused first.
+typedef struct {
+    uint32_t next;
+    int span;
+    size_t bytes;
+} Link;
+
+typedef union {
+    struct {
+        int data;
+        int level;
+        uint32_t next_free; // free runs only
+    } node;
+    Link link;
+} Cell;
+
+typedef struct {
+    Cell* cells;
+    uint32_t used, capacity;
+    uint32_t free_runs[MAX_LEVEL + 1]; // first free node of each level, or NIL
+    int level;
+    int count;
+    char* text; // " v1 v2 ..." for the current list, kept in step with every change
+    size_t text_len, text_cap;
+    int keep_text; // 0 in delta mode, which never prints the whole list; text_len is kept either way
+} List;
+
+#define DATA(list, n) ((list)->cells[n].node.data)
+#define LINK(list, n, i) ((list)->cells[(n) + 1 + (i)].link)
+
+//create a new node: reuses a freed node of the same level, else takes the
+//next cells of the arena
+uint32_t create_newnode(List* list, int value, int level) {
+    uint32_t n = list->free_runs[level];
+    if (n != NIL) {
+        list->free_runs[level] = list->cells[n].node.next_free;
+    } else {
+        if (list->used + level + 1 > list->capacity) {
+            while (list->used + level + 1 > list->capacity) list->capacity *= 2;
+            list->cells = (Cell*)realloc(list->cells, list->capacity * sizeof(Cell));
+        }
+        n = list->used;
+        list->used += level + 1;
     }
-    
-    
-
-    // If the value already exists, do not insert
-    if (((current->next) && (current->next->data == value)) || (current->data==value)) {
-        //printf("value exists already %d",(current->next)->data);
-        free(newNode);
-        return head;
-    } 
-    
-    // Insert the new node
-    newNode->next = current->next;
-    current->next = newNode;
-    return head;
+    list->cells[n].node.data = value;
+    list->cells[n].node.level = level;
+    for (int i = 0; i < level; i++) LINK(list, n, i) = (Link){ NIL, 0, 0 };
+    return n;
 }
 
+void free_node(List* list, uint32_t n) {
+    int level = list->cells[n].node.level;
+    list->cells[n].node.next_free = list->free_runs[level];
+    list->free_runs[level] = n;
+}
 
-//delete a value from the list
-Node* delete(Node* head, int value) {
-    if (head == NULL) return head; // List is empty
+void init_list(List* list) {
+    list->capacity = 1024;
+    list->cells = (Cell*)malloc(list->capacity * sizeof(Cell));
+    list->used = 0;
+    for (int i = 0; i <= MAX_LEVEL; i++) list->free_runs[i] = NIL;
+    create_newnode(list, 0, MAX_LEVEL); // HEAD
+    list->level = 1;
+    list->count = 0;
+    list->text_cap = 64;
+    list->text = (char*)malloc(list->text_cap);
+    list->text_len = 0;
+    list->keep_text = 1;
+}
 
-    // If head node needs to be deleted
-    if (head->data == value) {
-        Node* temp = head;
-        head = head->next;
-        free(temp);
-        return head;
+// Geometric level with p = 1/2 from a xorshift generator
+static int random_level(void) {
+    static unsigned long long seed = 0x9E3779B97F4A7C15ull;
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    int level = 1;
+    for (unsigned long long bits = seed; (bits & 1) && level < MAX_LEVEL; bits >>= 1) level++;
+    return level;
+}
+
+// Walks down to the last node below value on every level, recording it in
+// update[] and the node count / text bytes before it in rank[] / offset[]
+static uint32_t find_predecessors(const List* list, int value, uint32_t update[], int rank[], size_t offset[]) {
+    uint32_t current = HEAD;
+    for (int i = list->level - 1; i >= 0; i--) {
+        rank[i] = i == list->level - 1 ? 0 : rank[i + 1];
+        offset[i] = i == list->level - 1 ? 0 : offset[i + 1];
+        while (LINK(list, current, i).next != NIL && DATA(list, LINK(list, current, i).next) < value) {
+            rank[i] += LINK(list, current, i).span;
+            offset[i] += LINK(list, current, i).bytes;
+            current = LINK(list, current, i).next;
+        }
+        update[i] = current;
     }
+    return LINK(list, current, 0).next;
+}
+
+//insert a new value in sorted order without duplicates; returns its
+//0-based position, or -1 if it was already present
+int insert(List* list, int value) {
+    uint32_t update[MAX_LEVEL];
+    int rank[MAX_LEVEL];
+    size_t offset[MAX_LEVEL];
+    uint32_t next = find_predecessors(list, value, update, rank, offset);
+
+    // If the value already exists, do not insert; nothing has been allocated yet
+    if (next != NIL && DATA(list, next) == value) return -1;
 
-    // Search for the value
-    Node* current = head;
-    while (current->next != NULL && current->next->data != value) {
-        current = current->next;
+    char item[16];
+    size_t len = (size_t)snprintf(item, sizeof(item), " %d", value);
+    int level = random_level();
+    if (level > list->level) {
+        for (int i = list->level; i < level; i++) {
+            rank[i] = 0;
+            offset[i] = 0;
+            update[i] = HEAD;
+            LINK(list, HEAD, i).span = list->count;
+            LINK(list, HEAD, i).bytes = list->text_len;
+        }
+        list->level = level;
     }
 
-    // If found, delete the node
-    if (current->next != NULL) {
-        Node* temp = current->next;
-        current->next = temp->next;
-        free(temp);
+    // Insert the new node, splitting the spans it lands inside
+    uint32_t new_node = create_newnode(list, value, level);
+    for (int i = 0; i < level; i++) {
+        Link* before = &LINK(list, update[i], i);
+        Link* after = &LINK(list, new_node, i);
+        after->next = before->next;
+        after->span = before->span - (rank[0] - rank[i]);
+        after->bytes = before->bytes - (offset[0] - offset[i]);
+        before->next = new_node;
+        before->span = rank[0] - rank[i] + 1;
+        before->bytes = offset[0] - offset[i] + len;
+    }
+    for (int i = level; i < list->level; i++) {
+        LINK(list, update[i], i).span++;
+        LINK(list, update[i], i).bytes += len;
+    }
+    list->count++;
+    if (!list->keep_text) {
+        list->text_len += len; // the head's new top-level links take their bytes from it
+        return rank[0];
     }
 
-    return head;
+    // Splice the value into the printed text at its position
+    if (list->text_len + len > list->text_cap) {
+        while (list->text_len + len > list->text_cap) list->text_cap *= 2;
+        list->text = (char*)realloc(list->text, list->text_cap);
+    }
+    memmove(list->text + offset[0] + len, list->text + offset[0], list->text_len - offset[0]);
+    memcpy(list->text + offset[0], item, len);
+    list->text_len += len;
+    return rank[0];
 }
 
-// printing the list
-void print_list(Node* head) {
-    int count = 0;
-    Node* temp = head;
+//delete a value from the list; returns the position it had, or -1 if absent
+int delete(List* list, int value) {
+    uint32_t update[MAX_LEVEL];
+    int rank[MAX_LEVEL];
+    size_t offset[MAX_LEVEL];
+    uint32_t target = find_predecessors(list, value, update, rank, offset);
+    if (target == NIL || DATA(list, target) != value) return -1; // not in the list
 
-    // Count nodes
-    while (temp != NULL) {
-        count++;
-        temp = temp->next;
+    char item[16];
+    size_t len = (size_t)snprintf(item, sizeof(item), " %d", value);
+    for (int i = 0; i < list->level; i++) {
+        Link* before = &LINK(list, update[i], i);
+        if (before->next == target) {
+            before->span += LINK(list, target, i).span - 1;
+            before->bytes += LINK(list, target, i).bytes - len;
+            before->next = LINK(list, target, i).next;
+        } else {
+            before->span--;
+            before->bytes -= len;
+        }
+    }
+    free_node(list, target);
+    while (list->level > 1 && LINK(list, HEAD, list->level - 1).next == NIL) list->level--;
+    list->count--;
+    if (!list->keep_text) {
+        list->text_len -= len;
+        return rank[0];
     }
 
-    printf("%d :", count);
+    memmove(list->text + offset[0], list->text + offset[0] + len, list->text_len - offset[0] - len);
+    list->text_len -= len;
+    return rank[0];
+}
 
-    // Print nodes
-    temp = head;
-    while (temp != NULL) {
-        printf(" %d", temp->data);
-        temp = temp->next;
-    }
+// printing the list: the count and text are maintained, so this is a single write
+void print_list(const List* list) {
+    printf("%d :", list->count);
+    fwrite(list->text, 1, list->text_len, stdout);
     printf("\n");
 }
 
+// Every node is in the arena, so freeing the list is two frees
+void free_list(List* list) {
+    free(list->cells);
+    free(list->text);
+}
+
+// Delta mode prints, instead of the whole list, "count : +value @position"
+// for an insert, "count : -value @position" for a delete and "count :" when
+// nothing changed; positions are 0-based indexes into the printed list
+void print_delta(const List* list, char change, int value, int position) {
+    if (position < 0)
+        printf("%d :\n", list->count);
+    else
+        printf("%d : %c%d @%d\n", list->count, change, value, position);
+}
+
+// Companion to delta mode: replays a delta stream and prints the full
+// per-step output the plain mode would have produced
+int reconstruct(void) {
+    List list;
+    char line[64];
+    long line_no = 0;
+    init_list(&list);
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        line_no++;
+        int count, value, position;
+        char change;
+        if (strcmp(line, "Invalid command\n") == 0) {
+            printf("Invalid command\n");
+            continue;
+        }
+        int fields = sscanf(line, "%d : %c%d @%d", &count, &change, &value, &position);
+        if (fields == 4 && change == '+') {
+            if (insert(&list, value) != position) fields = 0;
+        } else if (fields == 4 && change == '-') {
+            if (delete(&list, value) != position) fields = 0;
+        } else if (fields != 1) {
+            fields = 0;
+        }
+        if (fields == 0 || count != list.count) {
+            fprintf(stderr, "Delta stream does not match at line %ld\n", line_no);
+            free_list(&list);
+            return 1;
+        }
+        print_list(&list);
+    }
+    free_list(&list);
+    return 0;
+}
+
 // Main function to test input files
-int main() {
-    Node* head = NULL;
+int main(int argc, char* argv[]) {
+    List list;
     char command;
     int value;
+    int delta = 0;
+
+    if (argc == 2 && strcmp(argv[1], "--delta") == 0) {
+        delta = 1;
+    } else if (argc == 2 && strcmp(argv[1], "--reconstruct") == 0) {
+        return reconstruct();
+    } else if (argc != 1) {
+        fprintf(stderr, "Usage: %s [--delta | --reconstruct] < commands\n", argv[0]);
+        return 1;
+    }
 
+    init_list(&list);
+    list.keep_text = !delta; // the O(n) text splice is only needed when the list is printed
     while (scanf(" %c %d", &command, &value) != EOF) {
+        char change = 0;
+        int position = -1;
         if (command == 'i') {
-            head = insert(head, value);
+            change = '+';
+            position = insert(&list, value);
         } else if (command == 'd') {
-            head = delete(head, value);
+            change = '-';
+            position = delete(&list, value);
         } else {
             printf("Invalid command\n");
         }
-        print_list(head);
+        if (delta)
+            print_delta(&list, change, value, position);
+        else
+            print_list(&list);
     }
 
     // free memory
-    while (head != NULL) {
-        Node* temp = head;
-        head = head->next;
-        free(temp);
-    }
+    free_list(&list);
 
     return 0;
-}
\ No newline at end of file
+}
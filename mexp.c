@@ -1,105 +1,1037 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 
+#define MATRIX_ALIGN 32
+#define TILE_ROWS 4
+#define TILE_COLS 16
+#define BLOCK_COLS 256
+#define BLOCK_DEPTH 256
+#define SPARSE_DENSITY 0.1
+#define STRASSEN_CUTOFF 256
 
-void multiply_matrices(int **result, int **A, int **B, int k) {
-    int **temp = (int **)malloc(k * sizeof(int *));
-    for (int i = 0; i < k; i++) {
-        temp[i] = (int *)malloc(k * sizeof(int));
+// Element arithmetic, chosen with --mode:
+//   int32  32-bit ints, wrapping on overflow (the original behaviour)
+//   int64  64-bit ints, wrapping on overflow
+//   wide   exact 64-bit results from 128-bit accumulators; overflow is reported
+//   mod:P  residues modulo P (2 <= P < 2^32) with Barrett reduction
+typedef enum { MODE_INT32, MODE_INT64, MODE_WIDE, MODE_MOD } ElementMode;
+
+// Square k x k matrix in one aligned block, row-major. Rows are padded to a
+// multiple of TILE_COLS elements and the padding is kept zero. Elements are
+// int in int32 mode and 64-bit otherwise.
+typedef struct {
+    int k;
+    int stride;
+    size_t elem_size;
+    void *data;
+} Matrix;
+
+#define AT32(M, i, j) (((int *)(M)->data)[(size_t)(i) * (M)->stride + (j)])
+#define AT64(M, i, j) (((uint64_t *)(M)->data)[(size_t)(i) * (M)->stride + (j)])
+
+static int thread_count = 1;
+static ElementMode element_mode = MODE_INT32;
+static uint64_t modulus;
+static uint64_t barrett_factor;  // floor(2^64 / modulus)
+static int mod_chunk;            // products that fit in a 64-bit accumulator between reductions
+static volatile int overflowed;
+static double sparse_density = SPARSE_DENSITY;  // nonzero fraction above which products go dense
+static int strassen_cutoff = STRASSEN_CUTOFF;    // largest size multiplied without Strassen; 0 disables it
+
+Matrix *create_matrix(int k) {
+    Matrix *M = (Matrix *)malloc(sizeof(Matrix));
+    M->k = k;
+    M->stride = (k + TILE_COLS - 1) / TILE_COLS * TILE_COLS;
+    M->elem_size = element_mode == MODE_INT32 ? sizeof(int) : sizeof(uint64_t);
+    size_t bytes = (size_t)(k ? k : 1) * M->stride * M->elem_size;
+    bytes = (bytes + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+    M->data = aligned_alloc(MATRIX_ALIGN, bytes);
+    memset(M->data, 0, bytes);
+    return M;
+}
+
+void free_matrix(Matrix *M) {
+    free(M->data);
+    free(M);
+}
+
+static inline void *element_ptr(const Matrix *M, int i, int j) {
+    return (char *)M->data + ((size_t)i * M->stride + j) * M->elem_size;
+}
+
+void set_element(Matrix *M, int i, int j, long long value) {
+    if (element_mode == MODE_INT32) {
+        AT32(M, i, j) = (int)value;
+    } else if (element_mode == MODE_MOD) {
+        long long r = value % (long long)modulus;
+        AT64(M, i, j) = (uint64_t)(r < 0 ? r + (long long)modulus : r);
+    } else {
+        AT64(M, i, j) = (uint64_t)value;
     }
+}
 
-    // Multiply A and B, store in temp
-    for (int i = 0; i < k; i++) {
-        for (int j = 0; j < k; j++) {
-            temp[i][j] = 0;
-            for (int l = 0; l < k; l++) {
-                temp[i][j] += A[i][l] * B[l][j];
+static void set_modulus(uint64_t p) {
+    modulus = p;
+    barrett_factor = (uint64_t)(((unsigned __int128)1 << 64) / p);
+    unsigned __int128 square = (unsigned __int128)(p - 1) * (p - 1);
+    unsigned __int128 chunk = square ? (UINT64_MAX - p) / square : BLOCK_DEPTH;
+    mod_chunk = chunk > BLOCK_DEPTH ? BLOCK_DEPTH : (int)chunk;
+}
+
+// x mod modulus for any 64-bit x: the quotient estimate is at most one short
+static inline uint64_t barrett_reduce(uint64_t x) {
+    uint64_t q = (uint64_t)(((unsigned __int128)x * barrett_factor) >> 64);
+    uint64_t r = x - q * modulus;
+    return r >= modulus ? r - modulus : r;
+}
+
+// Register tiles: C[0..rows) x [0..TILE_COLS) += A[0..rows) x [0..depth) * B[0..depth) x [0..TILE_COLS)
+typedef void (*TileKernel)(int rows, int depth, const void *A, int lda,
+                           const void *B, int ldb, void *C, int ldc);
+
+// int32: arithmetic is done in unsigned so overflow wraps exactly like the int results always did
+static void multiply_tile_int32(int rows, int depth, const void *Av, int lda,
+                                const void *Bv, int ldb, void *Cv, int ldc) {
+    const int *A = (const int *)Av, *B = (const int *)Bv;
+    int *C = (int *)Cv;
+#ifdef __AVX2__
+    if (rows == TILE_ROWS) {
+        __m256i c[TILE_ROWS][2];
+        for (int r = 0; r < TILE_ROWS; r++) {
+            c[r][0] = _mm256_load_si256((const __m256i *)(C + r * ldc));
+            c[r][1] = _mm256_load_si256((const __m256i *)(C + r * ldc + 8));
+        }
+        for (int p = 0; p < depth; p++) {
+            __m256i b0 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb));
+            __m256i b1 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb + 8));
+            for (int r = 0; r < TILE_ROWS; r++) {
+                __m256i a = _mm256_set1_epi32(A[r * lda + p]);
+                c[r][0] = _mm256_add_epi32(c[r][0], _mm256_mullo_epi32(a, b0));
+                c[r][1] = _mm256_add_epi32(c[r][1], _mm256_mullo_epi32(a, b1));
+            }
+        }
+        for (int r = 0; r < TILE_ROWS; r++) {
+            _mm256_store_si256((__m256i *)(C + r * ldc), c[r][0]);
+            _mm256_store_si256((__m256i *)(C + r * ldc + 8), c[r][1]);
+        }
+        return;
+    }
+#endif
+    for (int r = 0; r < rows; r++) {
+        unsigned acc[TILE_COLS];
+        for (int j = 0; j < TILE_COLS; j++) acc[j] = (unsigned)C[r * ldc + j];
+        for (int p = 0; p < depth; p++) {
+            unsigned a = (unsigned)A[r * lda + p];
+            const int *b = B + (size_t)p * ldb;
+            for (int j = 0; j < TILE_COLS; j++) acc[j] += a * (unsigned)b[j];
+        }
+        for (int j = 0; j < TILE_COLS; j++) C[r * ldc + j] = (int)acc[j];
+    }
+}
+
+#ifdef __AVX2__
+// Low 64 bits of a 64 x 64-bit product per lane; AVX2 has no vpmullq
+static inline __m256i mullo_epi64(__m256i a, __m256i b) {
+    __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                     _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(_mm256_mul_epu32(a, b), _mm256_slli_epi64(cross, 32));
+}
+#endif
+
+// int64 (and wide mode when no partial sum can overflow): wrapping 64-bit multiply-add
+static void multiply_tile_int64(int rows, int depth, const void *Av, int lda,
+                                const void *Bv, int ldb, void *Cv, int ldc) {
+    const uint64_t *A = (const uint64_t *)Av, *B = (const uint64_t *)Bv;
+    uint64_t *C = (uint64_t *)Cv;
+#ifdef __AVX2__
+    if (rows == TILE_ROWS) {
+        for (int half = 0; half < TILE_COLS; half += 8) {
+            __m256i c[TILE_ROWS][2];
+            for (int r = 0; r < TILE_ROWS; r++) {
+                c[r][0] = _mm256_load_si256((const __m256i *)(C + r * ldc + half));
+                c[r][1] = _mm256_load_si256((const __m256i *)(C + r * ldc + half + 4));
+            }
+            for (int p = 0; p < depth; p++) {
+                __m256i b0 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb + half));
+                __m256i b1 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb + half + 4));
+                for (int r = 0; r < TILE_ROWS; r++) {
+                    __m256i a = _mm256_set1_epi64x((long long)A[r * lda + p]);
+                    c[r][0] = _mm256_add_epi64(c[r][0], mullo_epi64(a, b0));
+                    c[r][1] = _mm256_add_epi64(c[r][1], mullo_epi64(a, b1));
+                }
             }
+            for (int r = 0; r < TILE_ROWS; r++) {
+                _mm256_store_si256((__m256i *)(C + r * ldc + half), c[r][0]);
+                _mm256_store_si256((__m256i *)(C + r * ldc + half + 4), c[r][1]);
+            }
+        }
+        return;
+    }
+#endif
+    for (int r = 0; r < rows; r++) {
+        uint64_t acc[TILE_COLS];
+        for (int j = 0; j < TILE_COLS; j++) acc[j] = C[r * ldc + j];
+        for (int p = 0; p < depth; p++) {
+            uint64_t a = A[r * lda + p];
+            const uint64_t *b = B + (size_t)p * ldb;
+            for (int j = 0; j < TILE_COLS; j++) acc[j] += a * b[j];
         }
+        for (int j = 0; j < TILE_COLS; j++) C[r * ldc + j] = acc[j];
     }
+}
 
-    // Copy temp to result
-    for (int i = 0; i < k; i++) {
-        for (int j = 0; j < k; j++) {
-            result[i][j] = temp[i][j];
+// wide mode when overflow is possible: exact signed 128-bit sums, flagged if a result leaves int64
+static void multiply_tile_wide(int rows, int depth, const void *Av, int lda,
+                               const void *Bv, int ldb, void *Cv, int ldc) {
+    const int64_t *A = (const int64_t *)Av, *B = (const int64_t *)Bv;
+    int64_t *C = (int64_t *)Cv;
+    for (int r = 0; r < rows; r++) {
+        __int128 acc[TILE_COLS];
+        for (int j = 0; j < TILE_COLS; j++) acc[j] = C[r * ldc + j];
+        for (int p = 0; p < depth; p++) {
+            __int128 a = A[r * lda + p];
+            const int64_t *b = B + (size_t)p * ldb;
+            for (int j = 0; j < TILE_COLS; j++) acc[j] += a * b[j];
+        }
+        for (int j = 0; j < TILE_COLS; j++) {
+            if (acc[j] > INT64_MAX || acc[j] < INT64_MIN) overflowed = 1;
+            C[r * ldc + j] = (int64_t)acc[j];
         }
     }
+}
 
-    // Free temp matrix
+// wide mode when even 128-bit partial sums may overflow: every add records the
+// direction it wrapped in, and an entry is exact only if its wraps cancel out
+// and the final sum fits in int64
+static void multiply_tile_checked(int rows, int depth, const void *Av, int lda,
+                                  const void *Bv, int ldb, void *Cv, int ldc) {
+    const int64_t *A = (const int64_t *)Av, *B = (const int64_t *)Bv;
+    int64_t *C = (int64_t *)Cv;
+    for (int r = 0; r < rows; r++) {
+        __int128 acc[TILE_COLS];
+        int wraps[TILE_COLS];
+        for (int j = 0; j < TILE_COLS; j++) {
+            acc[j] = C[r * ldc + j];
+            wraps[j] = 0;
+        }
+        for (int p = 0; p < depth; p++) {
+            __int128 a = A[r * lda + p];
+            const int64_t *b = B + (size_t)p * ldb;
+            for (int j = 0; j < TILE_COLS; j++) {
+                __int128 product = a * b[j]; //|product| < 2^126, so only the sum can wrap
+                if (__builtin_add_overflow(acc[j], product, &acc[j])) wraps[j] += product < 0 ? -1 : 1;
+            }
+        }
+        for (int j = 0; j < TILE_COLS; j++) {
+            if (wraps[j] || acc[j] > INT64_MAX || acc[j] < INT64_MIN) overflowed = 1;
+            C[r * ldc + j] = (int64_t)acc[j];
+        }
+    }
+}
+
+// mod mode: residues are below 2^32, so each product fits in 64 bits and
+// mod_chunk of them can be summed in a lane before a Barrett reduction
+static void multiply_tile_mod(int rows, int depth, const void *Av, int lda,
+                              const void *Bv, int ldb, void *Cv, int ldc) {
+    const uint64_t *A = (const uint64_t *)Av, *B = (const uint64_t *)Bv;
+    uint64_t *C = (uint64_t *)Cv;
+#ifdef __AVX2__
+    if (rows == TILE_ROWS) {
+        for (int half = 0; half < TILE_COLS; half += 8) {
+            for (int p0 = 0; p0 < depth; p0 += mod_chunk) {
+                int p_end = p0 + mod_chunk < depth ? p0 + mod_chunk : depth;
+                __m256i c[TILE_ROWS][2];
+                for (int r = 0; r < TILE_ROWS; r++) {
+                    c[r][0] = _mm256_load_si256((const __m256i *)(C + r * ldc + half));
+                    c[r][1] = _mm256_load_si256((const __m256i *)(C + r * ldc + half + 4));
+                }
+                for (int p = p0; p < p_end; p++) {
+                    __m256i b0 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb + half));
+                    __m256i b1 = _mm256_load_si256((const __m256i *)(B + (size_t)p * ldb + half + 4));
+                    for (int r = 0; r < TILE_ROWS; r++) {
+                        __m256i a = _mm256_set1_epi64x((long long)A[r * lda + p]);
+                        c[r][0] = _mm256_add_epi64(c[r][0], _mm256_mul_epu32(a, b0));
+                        c[r][1] = _mm256_add_epi64(c[r][1], _mm256_mul_epu32(a, b1));
+                    }
+                }
+                for (int r = 0; r < TILE_ROWS; r++) {
+                    uint64_t *out = C + r * ldc + half;
+                    _mm256_store_si256((__m256i *)out, c[r][0]);
+                    _mm256_store_si256((__m256i *)(out + 4), c[r][1]);
+                    for (int j = 0; j < 8; j++) out[j] = barrett_reduce(out[j]);
+                }
+            }
+        }
+        return;
+    }
+#endif
+    for (int r = 0; r < rows; r++) {
+        for (int p0 = 0; p0 < depth; p0 += mod_chunk) {
+            int p_end = p0 + mod_chunk < depth ? p0 + mod_chunk : depth;
+            uint64_t acc[TILE_COLS];
+            for (int j = 0; j < TILE_COLS; j++) acc[j] = C[r * ldc + j];
+            for (int p = p0; p < p_end; p++) {
+                uint64_t a = A[r * lda + p];
+                const uint64_t *b = B + (size_t)p * ldb;
+                for (int j = 0; j < TILE_COLS; j++) acc[j] += a * b[j];
+            }
+            for (int j = 0; j < TILE_COLS; j++) C[r * ldc + j] = barrett_reduce(acc[j]);
+        }
+    }
+}
+
+typedef struct {
+    Matrix *result;
+    const Matrix *A, *B;
+    int first_row, last_row;
+    TileKernel kernel;
+    int block_depth;
+} MultiplyTask;
+
+// Blocked multiply of one band of result rows
+static void *multiply_rows(void *arg) {
+    MultiplyTask *task = (MultiplyTask *)arg;
+    Matrix *C = task->result;
+    const Matrix *A = task->A, *B = task->B;
+    int k = A->k;
+
+    // Clears only the tile-padded width so a quadrant view leaves its neighbours alone
+    size_t row_bytes = (size_t)(k + TILE_COLS - 1) / TILE_COLS * TILE_COLS * C->elem_size;
+    for (int i = task->first_row; i < task->last_row; i++) {
+        memset(element_ptr(C, i, 0), 0, row_bytes);
+    }
+    for (int ll = 0; ll < k; ll += task->block_depth) {
+        int depth = k - ll < task->block_depth ? k - ll : task->block_depth;
+        for (int jj = 0; jj < k; jj += BLOCK_COLS) {
+            int j_end = jj + BLOCK_COLS < k ? jj + BLOCK_COLS : k;
+            for (int i = task->first_row; i < task->last_row; i += TILE_ROWS) {
+                int rows = task->last_row - i < TILE_ROWS ? task->last_row - i : TILE_ROWS;
+                for (int j = jj; j < j_end; j += TILE_COLS) {
+                    task->kernel(rows, depth, element_ptr(A, i, ll), A->stride,
+                                 element_ptr(B, ll, j), B->stride, element_ptr(C, i, j), C->stride);
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+static uint64_t max_magnitude(const Matrix *M) {
+    uint64_t max = 0;
+    for (int i = 0; i < M->k; i++) {
+        for (int j = 0; j < M->k; j++) {
+            int64_t v = (int64_t)AT64(M, i, j);
+            uint64_t mag = v < 0 ? -(uint64_t)v : (uint64_t)v;
+            if (mag > max) max = mag;
+        }
+    }
+    return max;
+}
+
+// Splits the result rows into bands across thread_count threads
+static void multiply_blocked(Matrix *result, const Matrix *A, const Matrix *B,
+                             TileKernel kernel, int block_depth) {
+    int k = A->k;
+    int threads = thread_count;
+    if (threads > k / TILE_ROWS) threads = k / TILE_ROWS;
+    if (threads < 1) threads = 1;
+
+    MultiplyTask tasks[threads];
+    pthread_t ids[threads];
+    int tiles = (k + TILE_ROWS - 1) / TILE_ROWS;
+    int band = (tiles + threads - 1) / threads * TILE_ROWS;
+    for (int t = 0; t < threads; t++) {
+        int first = t * band < k ? t * band : k;
+        int last = first + band < k ? first + band : k;
+        tasks[t] = (MultiplyTask){ result, A, B, first, last, kernel, block_depth > 0 ? block_depth : 1 };
+        if (t > 0) pthread_create(&ids[t], NULL, multiply_rows, &tasks[t]);
+    }
+    multiply_rows(&tasks[0]);
+    for (int t = 1; t < threads; t++) pthread_join(ids[t], NULL);
+}
+
+
+// Bump allocator for Strassen temporaries; it only grows and is rewound
+// after each multiply, so repeated squarings do not allocate
+typedef struct {
+    char *base;
+    size_t used, size;
+} Arena;
+
+static Arena arena;
+
+static size_t matrix_bytes(int k) {
+    size_t stride = (size_t)(k + TILE_COLS - 1) / TILE_COLS * TILE_COLS;
+    size_t elem = element_mode == MODE_INT32 ? sizeof(int) : sizeof(uint64_t);
+    return ((k ? k : 1) * stride * elem + MATRIX_ALIGN - 1) / MATRIX_ALIGN * MATRIX_ALIGN;
+}
+
+static void arena_reserve(size_t bytes) {
+    if (bytes <= arena.size) return;
+    free(arena.base);
+    arena.base = (char *)aligned_alloc(MATRIX_ALIGN, bytes);
+    arena.size = bytes;
+}
+
+static void arena_release(void) {
+    free(arena.base);
+    arena = (Arena){ NULL, 0, 0 };
+}
+
+static Matrix arena_matrix(int k) {
+    Matrix M = { k, (k + TILE_COLS - 1) / TILE_COLS * TILE_COLS,
+                 element_mode == MODE_INT32 ? sizeof(int) : sizeof(uint64_t), arena.base + arena.used };
+    arena.used += matrix_bytes(k);
+    return M;
+}
+
+// View of one quadrant of an even-sized matrix, sharing its storage
+static Matrix quadrant(const Matrix *M, int r, int c) {
+    int h = M->k / 2;
+    return (Matrix){ h, M->stride, M->elem_size, element_ptr(M, r * h, c * h) };
+}
+
+// C = A + B, or A - B when subtract is set, in the element ring (wrapping or
+// modulo P). C may alias A or B.
+static void add_matrices(Matrix *C, const Matrix *A, const Matrix *B, int subtract) {
+    int k = C->k;
     for (int i = 0; i < k; i++) {
-        free(temp[i]);
+        if (element_mode == MODE_INT32) {
+            unsigned *c = element_ptr(C, i, 0);
+            const unsigned *a = element_ptr(A, i, 0), *b = element_ptr(B, i, 0);
+            if (subtract)
+                for (int j = 0; j < k; j++) c[j] = a[j] - b[j];
+            else
+                for (int j = 0; j < k; j++) c[j] = a[j] + b[j];
+        } else if (element_mode == MODE_MOD) {
+            uint64_t *c = element_ptr(C, i, 0);
+            const uint64_t *a = element_ptr(A, i, 0), *b = element_ptr(B, i, 0);
+            if (subtract)
+                for (int j = 0; j < k; j++) c[j] = a[j] >= b[j] ? a[j] - b[j] : a[j] + modulus - b[j];
+            else
+                for (int j = 0; j < k; j++) c[j] = a[j] + b[j] >= modulus ? a[j] + b[j] - modulus : a[j] + b[j];
+        } else {
+            uint64_t *c = element_ptr(C, i, 0);
+            const uint64_t *a = element_ptr(A, i, 0), *b = element_ptr(B, i, 0);
+            if (subtract)
+                for (int j = 0; j < k; j++) c[j] = a[j] - b[j];
+            else
+                for (int j = 0; j < k; j++) c[j] = a[j] + b[j];
+        }
+    }
+}
+
+// One level of Strassen-Winograd (7 multiplies, 15 additions) using the
+// two-temporary schedule of Douglas et al.; the blocked kernel runs at the leaves
+static void strassen_step(Matrix *C, const Matrix *A, const Matrix *B,
+                          TileKernel kernel, int block_depth, int levels) {
+    int k = A->k;
+    if (levels == 0) {
+        multiply_blocked(C, A, B, kernel, block_depth);
+        return;
     }
-    free(temp);
+    Matrix A11 = quadrant(A, 0, 0), A12 = quadrant(A, 0, 1), A21 = quadrant(A, 1, 0), A22 = quadrant(A, 1, 1);
+    Matrix B11 = quadrant(B, 0, 0), B12 = quadrant(B, 0, 1), B21 = quadrant(B, 1, 0), B22 = quadrant(B, 1, 1);
+    Matrix C11 = quadrant(C, 0, 0), C12 = quadrant(C, 0, 1), C21 = quadrant(C, 1, 0), C22 = quadrant(C, 1, 1);
+    size_t mark = arena.used;
+    Matrix X = arena_matrix(k / 2), Y = arena_matrix(k / 2);
+
+    add_matrices(&X, &A11, &A21, 1);                                   // S3 = A11 - A21
+    add_matrices(&Y, &B22, &B12, 1);                                   // T3 = B22 - B12
+    strassen_step(&C21, &X, &Y, kernel, block_depth, levels - 1);      // P7 = S3 T3
+    add_matrices(&X, &A21, &A22, 0);                                   // S1 = A21 + A22
+    add_matrices(&Y, &B12, &B11, 1);                                   // T1 = B12 - B11
+    strassen_step(&C22, &X, &Y, kernel, block_depth, levels - 1);      // P5 = S1 T1
+    add_matrices(&X, &X, &A11, 1);                                     // S2 = S1 - A11
+    add_matrices(&Y, &B22, &Y, 1);                                     // T2 = B22 - T1
+    strassen_step(&C12, &X, &Y, kernel, block_depth, levels - 1);      // P6 = S2 T2
+    add_matrices(&X, &A12, &X, 1);                                     // S4 = A12 - S2
+    strassen_step(&C11, &X, &B22, kernel, block_depth, levels - 1);    // P3 = S4 B22
+    strassen_step(&X, &A11, &B11, kernel, block_depth, levels - 1);    // P1 = A11 B11
+    add_matrices(&C12, &X, &C12, 0);                                   // U2 = P1 + P6
+    add_matrices(&C21, &C12, &C21, 0);                                 // U3 = U2 + P7
+    add_matrices(&C12, &C12, &C22, 0);                                 // U4 = U2 + P5
+    add_matrices(&C22, &C21, &C22, 0);                                 // C22 = U3 + P5
+    add_matrices(&C12, &C12, &C11, 0);                                 // C12 = U4 + P3
+    add_matrices(&Y, &Y, &B21, 1);                                     // T4 = T2 - B21
+    strassen_step(&C11, &A22, &Y, kernel, block_depth, levels - 1);    // P4 = A22 T4
+    add_matrices(&C21, &C21, &C11, 1);                                 // C21 = U3 - P4
+    strassen_step(&C11, &A12, &B21, kernel, block_depth, levels - 1);  // P2 = A12 B21
+    add_matrices(&C11, &X, &C11, 0);                                   // C11 = P1 + P2
 
+    arena.used = mark;
 }
 
-void matrix_exponentiation(int **M, int k, int n) {
-    // Allocates space for result matrix
-    int **result = (int **)malloc(k * sizeof(int *));
-    int **temp = (int **)malloc(k * sizeof(int *));
+// Pads the operands with zeros to a size that halves into whole tiles down to
+// the cutoff, runs the recursion, and copies the product back out
+static void strassen_multiply(Matrix *result, const Matrix *A, const Matrix *B,
+                              TileKernel kernel, int block_depth) {
+    int k = A->k;
+    int levels = 0;
+    while ((k >> levels) > strassen_cutoff) levels++;
+    int unit = TILE_COLS << levels;
+    int m = (k + unit - 1) / unit * unit;
+
+    size_t bytes = 0;
+    for (int h = m / 2, l = 0; l < levels; h /= 2, l++) bytes += 2 * matrix_bytes(h);
+    if (m != k) bytes += 3 * matrix_bytes(m);
+    arena_reserve(bytes);
+    arena.used = 0;
+
+    if (m == k) {
+        strassen_step(result, A, B, kernel, block_depth, levels);
+    } else {
+        Matrix Ap = arena_matrix(m), Bp = arena_matrix(m), Cp = arena_matrix(m);
+        memset(Ap.data, 0, 2 * matrix_bytes(m));
+        for (int i = 0; i < k; i++) {
+            memcpy(element_ptr(&Ap, i, 0), element_ptr(A, i, 0), A->stride * A->elem_size);
+            memcpy(element_ptr(&Bp, i, 0), element_ptr(B, i, 0), B->stride * B->elem_size);
+        }
+        strassen_step(&Cp, &Ap, &Bp, kernel, block_depth, levels);
+        for (int i = 0; i < k; i++) {
+            memcpy(element_ptr(result, i, 0), element_ptr(&Cp, i, 0), result->stride * result->elem_size);
+        }
+    }
+    arena.used = 0;
+}
+
+void multiply_matrices(Matrix *result, const Matrix *A, const Matrix *B) {
+    // result must not alias A or B
+    int k = A->k;
+    TileKernel kernel = multiply_tile_int32;
+    int block_depth = BLOCK_DEPTH;
+    if (element_mode == MODE_INT64) {
+        kernel = multiply_tile_int64;
+    } else if (element_mode == MODE_MOD) {
+        kernel = multiply_tile_mod;
+    } else if (element_mode == MODE_WIDE) {
+        // If k * max|A| * max|B| fits in int64 no partial sum can overflow and the
+        // vectorized 64-bit kernel is exact; if it fits in int128 each entry is
+        // summed in one 128-bit pass; beyond that the sums are checked term by term.
+        // The bound only picks the kernel: overflow is reported per result entry.
+        unsigned __int128 bound = (unsigned __int128)max_magnitude(A) * max_magnitude(B);
+        if (bound <= (unsigned __int128)INT64_MAX / (k ? k : 1)) {
+            kernel = multiply_tile_int64;
+        } else {
+            int fits = bound <= ((((unsigned __int128)1 << 127) - 1) / k);
+            kernel = fits ? multiply_tile_wide : multiply_tile_checked;
+            block_depth = k;
+        }
+    }
+
+    // Strassen works in any ring, so it is exact for the wrapping and modular
+    // modes and for wide mode whenever the 64-bit kernel is
+    if (strassen_cutoff > 0 && k > strassen_cutoff && kernel != multiply_tile_wide && kernel != multiply_tile_checked)
+        strassen_multiply(result, A, B, kernel, block_depth);
+    else
+        multiply_blocked(result, A, B, kernel, block_depth);
+}
+
+void print_matrix(const Matrix *M, int trailing_space) {
+    for (int i = 0; i < M->k; i++) {
+        for (int j = 0; j < M->k; j++) {
+            if (element_mode == MODE_INT32)
+                printf("%d", AT32(M, i, j));
+            else if (element_mode == MODE_MOD)
+                printf("%llu", (unsigned long long)AT64(M, i, j));
+            else
+                printf("%lld", (long long)(int64_t)AT64(M, i, j));
+            if (trailing_space || j < M->k - 1)
+                printf(" ");
+        }
+        printf("\n");
+    }
+}
+
+// Compressed sparse row matrix. Values are kept as signed 64-bit integers in
+// every mode (int32 entries sign-extended, residues below 2^32); the columns
+// of a row are in no particular order.
+typedef struct {
+    int k;
+    size_t nnz, capacity;
+    size_t *row_start;  // k + 1 offsets into cols and values
+    int *cols;
+    int64_t *values;
+} SparseMatrix;
+
+// Gustavson SpGEMM scratch: one dense accumulator row plus the columns it touched
+typedef struct {
+    unsigned __int128 *acc;
+    int *marker;  // last row (+1) that touched each column
+    int *touched;
+    int *wraps;   // wide mode: net 128-bit wraps of each column's sum
+} SparseWorkspace;
+
+SparseMatrix *create_sparse(int k) {
+    SparseMatrix *S = (SparseMatrix *)malloc(sizeof(SparseMatrix));
+    S->k = k;
+    S->nnz = 0;
+    S->capacity = k ? (size_t)k : 1;
+    S->row_start = (size_t *)calloc((size_t)k + 1, sizeof(size_t));
+    S->cols = (int *)malloc(S->capacity * sizeof(int));
+    S->values = (int64_t *)malloc(S->capacity * sizeof(int64_t));
+    return S;
+}
+
+void free_sparse(SparseMatrix *S) {
+    free(S->row_start);
+    free(S->cols);
+    free(S->values);
+    free(S);
+}
+
+static void reserve_sparse(SparseMatrix *S, size_t needed) {
+    if (needed <= S->capacity) return;
+    while (S->capacity < needed) S->capacity *= 2;
+    S->cols = (int *)realloc(S->cols, S->capacity * sizeof(int));
+    S->values = (int64_t *)realloc(S->values, S->capacity * sizeof(int64_t));
+}
+
+static inline int64_t get_element(const Matrix *M, int i, int j) {
+    return element_mode == MODE_INT32 ? AT32(M, i, j) : (int64_t)AT64(M, i, j);
+}
+
+static size_t count_nonzeros(const Matrix *M) {
+    size_t nnz = 0;
+    for (int i = 0; i < M->k; i++) {
+        for (int j = 0; j < M->k; j++) nnz += get_element(M, i, j) != 0;
+    }
+    return nnz;
+}
+
+void dense_to_sparse(SparseMatrix *S, const Matrix *M) {
+    reserve_sparse(S, count_nonzeros(M));
+    size_t nnz = 0;
+    for (int i = 0; i < M->k; i++) {
+        S->row_start[i] = nnz;
+        for (int j = 0; j < M->k; j++) {
+            int64_t v = get_element(M, i, j);
+            if (v != 0) {
+                S->cols[nnz] = j;
+                S->values[nnz++] = v;
+            }
+        }
+    }
+    S->row_start[M->k] = S->nnz = nnz;
+}
+
+void sparse_to_dense(Matrix *M, const SparseMatrix *S) {
+    memset(M->data, 0, (size_t)M->k * M->stride * M->elem_size);
+    for (int i = 0; i < S->k; i++) {
+        for (size_t p = S->row_start[i]; p < S->row_start[i + 1]; p++) {
+            if (element_mode == MODE_INT32)
+                AT32(M, i, S->cols[p]) = (int)S->values[p];
+            else
+                AT64(M, i, S->cols[p]) = (uint64_t)S->values[p];
+        }
+    }
+}
+
+static SparseWorkspace *create_workspace(int k) {
+    SparseWorkspace *w = (SparseWorkspace *)malloc(sizeof(SparseWorkspace));
+    w->acc = (unsigned __int128 *)malloc((k ? k : 1) * sizeof(unsigned __int128));
+    w->marker = (int *)calloc(k ? k : 1, sizeof(int));
+    w->touched = (int *)malloc((k ? k : 1) * sizeof(int));
+    w->wraps = (int *)malloc((k ? k : 1) * sizeof(int));
+    return w;
+}
+
+static void free_workspace(SparseWorkspace *w) {
+    free(w->acc);
+    free(w->marker);
+    free(w->touched);
+    free(w->wraps);
+    free(w);
+}
+
+// Converts an exact (or, outside wide mode, wrapped) 128-bit sum to the mode's element value
+static inline int64_t finish_sum(unsigned __int128 sum) {
+    if (element_mode == MODE_INT32)
+        return (int32_t)(uint32_t)sum;
+    if (element_mode == MODE_INT64)
+        return (int64_t)(uint64_t)sum;
+    if (element_mode == MODE_MOD)
+        return (int64_t)(uint64_t)(sum % modulus);
+    __int128 s = (__int128)sum;
+    if (s > INT64_MAX || s < INT64_MIN) overflowed = 1;
+    return (int64_t)s;
+}
+
+static uint64_t sparse_max_magnitude(const SparseMatrix *S) {
+    uint64_t max = 0;
+    for (size_t p = 0; p < S->nnz; p++) {
+        int64_t v = S->values[p];
+        uint64_t mag = v < 0 ? -(uint64_t)v : (uint64_t)v;
+        if (mag > max) max = mag;
+    }
+    return max;
+}
+
+// C = A * B row by row (Gustavson). Products are summed in 128 bits, which is
+// exact for mod mode and wraps consistently for int32 and int64. In wide mode,
+// when the magnitude bound says the 128-bit sums could overflow, every add is
+// checked and its wraps counted, so only entries that truly leave int64 overflow.
+// C must not alias A or B; its arrays are reused and only grow.
+void sparse_multiply(SparseMatrix *C, const SparseMatrix *A, const SparseMatrix *B, SparseWorkspace *w) {
+    int k = A->k;
+    int checked = 0;
+    if (element_mode == MODE_WIDE) {
+        unsigned __int128 bound = (unsigned __int128)sparse_max_magnitude(A) * sparse_max_magnitude(B);
+        checked = bound > ((((unsigned __int128)1 << 127) - 1) / (k ? k : 1));
+    }
+    size_t nnz = 0;
     for (int i = 0; i < k; i++) {
-        result[i] = (int *)malloc(k * sizeof(int));
-        temp[i] = (int *)malloc(k * sizeof(int));
+        C->row_start[i] = nnz;
+        int count = 0;
+        for (size_t p = A->row_start[i]; p < A->row_start[i + 1]; p++) {
+            __int128 a = A->values[p];
+            int l = A->cols[p];
+            for (size_t q = B->row_start[l]; q < B->row_start[l + 1]; q++) {
+                int j = B->cols[q];
+                unsigned __int128 product = (unsigned __int128)(a * B->values[q]);
+                if (w->marker[j] != i + 1) {
+                    w->marker[j] = i + 1;
+                    w->touched[count++] = j;
+                    w->acc[j] = product;
+                    w->wraps[j] = 0;
+                } else if (checked) {
+                    __int128 sum;
+                    if (__builtin_add_overflow((__int128)w->acc[j], (__int128)product, &sum))
+                        w->wraps[j] += (__int128)product < 0 ? -1 : 1;
+                    w->acc[j] = (unsigned __int128)sum;
+                } else {
+                    w->acc[j] += product;
+                }
+            }
+        }
+        reserve_sparse(C, nnz + count);
+        for (int t = 0; t < count; t++) {
+            int j = w->touched[t];
+            if (checked && w->wraps[j]) overflowed = 1;
+            int64_t v = finish_sum(w->acc[j]);
+            if (v != 0) {
+                C->cols[nnz] = j;
+                C->values[nnz++] = v;
+            }
+        }
     }
+    C->row_start[k] = C->nnz = nnz;
+    // Row markers are i + 1, so they must be cleared before the next product reuses them
+    memset(w->marker, 0, (k ? k : 1) * sizeof(int));
+}
 
-    // Initializes result as identity matrix
+// Runs exponentiation by squaring on CSR matrices while both operands stay
+// below the density threshold. Leaves the state in the dense result and base
+// and returns the exponent bits still to be processed by the dense loop.
+static int sparse_exponentiation(const Matrix *M, int n, Matrix *result_out, Matrix *base_out) {
+    int k = M->k;
+    double limit = sparse_density * k * k;
+    SparseMatrix *result = create_sparse(k);
+    SparseMatrix *base = create_sparse(k);
+    SparseMatrix *scratch = create_sparse(k);
+    SparseWorkspace *w = create_workspace(k);
 
+    reserve_sparse(result, k);
     for (int i = 0; i < k; i++) {
-        for (int j = 0; j < k; j++) {
-            result[i][j] = (i == j) ? 1 : 0;
-            temp[i][j] = M[i][j];
+        result->row_start[i] = i;
+        result->cols[i] = i;
+        result->values[i] = 1;
+    }
+    result->row_start[k] = result->nnz = k;
+    dense_to_sparse(base, M);
+
+    int e = n;
+    for (; e > 0 && !overflowed; e >>= 1) {
+        // Fill-in has made the dense kernel the faster choice
+        if (result->nnz > limit || base->nnz > limit) break;
+        if (e & 1) {
+            sparse_multiply(scratch, result, base, w);
+            SparseMatrix *t = result; result = scratch; scratch = t;
+        }
+        if (e > 1) {
+            sparse_multiply(scratch, base, base, w);
+            SparseMatrix *t = base; base = scratch; scratch = t;
         }
     }
+    sparse_to_dense(result_out, result);
+    sparse_to_dense(base_out, base);
+
+    free_sparse(result);
+    free_sparse(base);
+    free_sparse(scratch);
+    free_workspace(w);
+    return e;
+}
+
+// Returns 0 if wide mode detected an overflow
+int matrix_exponentiation(const Matrix *M, int n) {
+    // Three preallocated buffers: the running result, the current square of M, and scratch
+    int k = M->k;
+    Matrix *result = create_matrix(k);
+    Matrix *base = create_matrix(k);
+    Matrix *scratch = create_matrix(k);
 
-    // If n == 0, return identity matrix
-    if (n == 0) {
+    // Sparse inputs start out in CSR and move to the dense kernel once fill-in
+    // crosses the density threshold
+    overflowed = 0;
+    int e = n;
+    if (count_nonzeros(M) <= sparse_density * k * k) {
+        e = sparse_exponentiation(M, n, result, base);
+    } else {
+        // Initializes result as identity matrix
         for (int i = 0; i < k; i++) {
+            set_element(result, i, i, 1);
+        }
+        memcpy(base->data, M->data, (size_t)k * M->stride * M->elem_size);
+    }
+
+    // Exponentiation by squaring: O(log n) multiplies, swapping buffers instead of allocating
+    for (; e > 0 && !overflowed; e >>= 1) {
+        if (e & 1) {
+            multiply_matrices(scratch, result, base);
+            Matrix *t = result; result = scratch; scratch = t;
+        }
+        if (e > 1) {
+            multiply_matrices(scratch, base, base);
+            Matrix *t = base; base = scratch; scratch = t;
+        }
+    }
+
+    // The identity (n == 0) has always been printed with a trailing space
+    int ok = !overflowed;
+    if (ok)
+        print_matrix(result, n == 0);
+
+    // Free allocated memory
+    free_matrix(result);
+    free_matrix(base);
+    free_matrix(scratch);
+    arena_release();
+    return ok;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Plain i-l-j multiply in the current element mode, used as the benchmark reference
+static void simple_multiply(Matrix *C, const Matrix *A, const Matrix *B) {
+    int k = A->k;
+    for (int i = 0; i < k; i++) {
+        for (int l = 0; l < k; l++) {
             for (int j = 0; j < k; j++) {
-                printf("%d ", result[i][j]);
+                if (element_mode == MODE_INT32)
+                    AT32(C, i, j) = (int)((unsigned)AT32(C, i, j) + (unsigned)AT32(A, i, l) * (unsigned)AT32(B, l, j));
+                else if (element_mode == MODE_MOD)
+                    AT64(C, i, j) = (AT64(C, i, j) + AT64(A, i, l) * AT64(B, l, j) % modulus) % modulus;
+                else
+                    AT64(C, i, j) += AT64(A, i, l) * AT64(B, l, j);
             }
-            printf("\n");
         }
-    } 
-    
-    else 
-    {
-        // Perform matrix exponentiation using repeated multiplication
-        for (int i = 0; i < n; i++) {
-            multiply_matrices(result, result, M, k);
+    }
+}
+
+// Times the blocked kernel against the plain i-l-j loop; one multiply-add counts as 2 ops
+void benchmark_multiply(int max_k) {
+    printf("%6s %8s %12s %12s %12s %8s\n", "k", "threads", "simple_ms", "blocked_ms", "blocked_GOPS", "match");
+    srand(211);
+    for (int k = 64; k <= max_k; k *= 2) {
+        Matrix *A = create_matrix(k), *B = create_matrix(k);
+        Matrix *simple = create_matrix(k), *blocked = create_matrix(k);
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) {
+                long long range = element_mode == MODE_MOD ? (long long)modulus : 201;
+                long long offset = element_mode == MODE_MOD ? 0 : 100;
+                set_element(A, i, j, ((long long)rand() * RAND_MAX + rand()) % range - offset);
+                set_element(B, i, j, ((long long)rand() * RAND_MAX + rand()) % range - offset);
+            }
         }
 
-        // Print the final matrix
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        simple_multiply(simple, A, B);
+        double simple_time = elapsed_seconds(&start);
 
-        for (int i = 0; i < k; i++) {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        multiply_matrices(blocked, A, B);
+        double blocked_time = elapsed_seconds(&start);
 
+        int match = memcmp(simple->data, blocked->data, (size_t)k * simple->stride * simple->elem_size) == 0;
+        printf("%6d %8d %12.2f %12.2f %12.2f %8s\n", k, thread_count, simple_time * 1e3,
+               blocked_time * 1e3, 2.0 * k * k * k / blocked_time * 1e-9, match ? "yes" : "NO");
+        free_matrix(A);
+        free_matrix(B);
+        free_matrix(simple);
+        free_matrix(blocked);
+    }
+}
+
+// Times one squaring through SpGEMM and through the dense kernel across input
+// densities, to place the crossover that SPARSE_DENSITY encodes
+void benchmark_sparse(int k) {
+    static const double densities[] = { 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.3, 0.5 };
+    printf("%6s %10s %12s %12s %12s %8s\n", "k", "density", "out_density", "sparse_ms", "dense_ms", "match");
+    srand(211);
+    for (size_t d = 0; d < sizeof(densities) / sizeof(densities[0]); d++) {
+        Matrix *A = create_matrix(k), *dense = create_matrix(k), *from_sparse = create_matrix(k);
+        for (int i = 0; i < k; i++) {
             for (int j = 0; j < k; j++) {
+                if (rand() < densities[d] * RAND_MAX)
+                    set_element(A, i, j, rand() % 201 - 100);
+            }
+        }
+        SparseMatrix *S = create_sparse(k), *product = create_sparse(k);
+        SparseWorkspace *w = create_workspace(k);
+        dense_to_sparse(S, A);
 
-                printf("%d",result[i][j]);
-                if (j < k - 1) 
-                    printf(" ");
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        sparse_multiply(product, S, S, w);
+        double sparse_time = elapsed_seconds(&start);
 
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        multiply_matrices(dense, A, A);
+        double dense_time = elapsed_seconds(&start);
+
+        sparse_to_dense(from_sparse, product);
+        int match = memcmp(dense->data, from_sparse->data, (size_t)k * dense->stride * dense->elem_size) == 0;
+        printf("%6d %10.4f %12.4f %12.2f %12.2f %8s\n", k, (double)S->nnz / ((double)k * k),
+               (double)product->nnz / ((double)k * k), sparse_time * 1e3, dense_time * 1e3, match ? "yes" : "NO");
+        free_sparse(S);
+        free_sparse(product);
+        free_workspace(w);
+        free_matrix(A);
+        free_matrix(dense);
+        free_matrix(from_sparse);
+    }
+}
+
+// Times the blocked kernel against Strassen at each cutoff that leaves at
+// least 64 x 64 leaves; STRASSEN_CUTOFF is picked from this table
+void benchmark_strassen(int max_k) {
+    printf("%6s %8s %8s %12s %10s %8s\n", "k", "threads", "cutoff", "ms", "speedup", "match");
+    srand(211);
+    int saved_cutoff = strassen_cutoff;
+    for (int k = 256; k <= max_k; k *= 2) {
+        Matrix *A = create_matrix(k), *B = create_matrix(k);
+        Matrix *blocked = create_matrix(k), *strassen = create_matrix(k);
+        for (int i = 0; i < k; i++) {
+            for (int j = 0; j < k; j++) {
+                long long range = element_mode == MODE_MOD ? (long long)modulus : 201;
+                long long offset = element_mode == MODE_MOD ? 0 : 100;
+                set_element(A, i, j, ((long long)rand() * RAND_MAX + rand()) % range - offset);
+                set_element(B, i, j, ((long long)rand() * RAND_MAX + rand()) % range - offset);
             }
-            printf("\n");
         }
+
+        struct timespec start;
+        strassen_cutoff = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        multiply_matrices(blocked, A, B);
+        double blocked_time = elapsed_seconds(&start);
+        printf("%6d %8d %8s %12.2f %10.2f %8s\n", k, thread_count, "-", blocked_time * 1e3, 1.0, "-");
+
+        for (int cutoff = k / 2; cutoff >= 64; cutoff /= 2) {
+            strassen_cutoff = cutoff;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            multiply_matrices(strassen, A, B);
+            double strassen_time = elapsed_seconds(&start);
+            int match = memcmp(blocked->data, strassen->data, (size_t)k * blocked->stride * blocked->elem_size) == 0;
+            printf("%6d %8d %8d %12.2f %10.2f %8s\n", k, thread_count, cutoff, strassen_time * 1e3,
+                   blocked_time / strassen_time, match ? "yes" : "NO");
+        }
+        free_matrix(A);
+        free_matrix(B);
+        free_matrix(blocked);
+        free_matrix(strassen);
     }
+    strassen_cutoff = saved_cutoff;
+    arena_release();
+}
 
-    // Free allocated memory
-    for (int i = 0; i < k; i++) {
-        free(result[i]);
-        free(temp[i]);
+static int parse_mode(const char *name) {
+    if (strcmp(name, "int32") == 0) {
+        element_mode = MODE_INT32;
+    } else if (strcmp(name, "int64") == 0) {
+        element_mode = MODE_INT64;
+    } else if (strcmp(name, "wide") == 0) {
+        element_mode = MODE_WIDE;
+    } else if (strncmp(name, "mod:", 4) == 0) {
+        char *end;
+        unsigned long long p = strtoull(name + 4, &end, 10);
+        if (*end != '\0' || p < 2 || p > UINT32_MAX) return 0;
+        element_mode = MODE_MOD;
+        set_modulus(p);
+    } else {
+        return 0;
     }
+    return 1;
+}
 
-    free(result);
-    free(temp);
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--threads N] [--mode int32|int64|wide|mod:P] [--density D]\n"
+                    "          [--strassen CUTOFF] <input_file>\n", prog);
+    fprintf(stderr, "       %s [--threads N] [--mode ...] --bench [max_k]\n", prog);
+    fprintf(stderr, "       %s [--threads N] [--mode ...] --bench-sparse [k]\n", prog);
+    fprintf(stderr, "       %s [--threads N] [--mode ...] --bench-strassen [max_k]\n", prog);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <input_file>\n", argv[0]);
+    int argi = 1;
+    int bench = 0, bench_sparse = 0, bench_strassen = 0;
+    for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+        if (strcmp(argv[argi], "--threads") == 0 && argi + 1 < argc) {
+            thread_count = atoi(argv[++argi]);
+            if (thread_count < 1) thread_count = 1;
+        } else if (strcmp(argv[argi], "--mode") == 0 && argi + 1 < argc) {
+            if (!parse_mode(argv[++argi])) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[argi], "--density") == 0 && argi + 1 < argc) {
+            sparse_density = atof(argv[++argi]);
+        } else if (strcmp(argv[argi], "--strassen") == 0 && argi + 1 < argc) {
+            strassen_cutoff = atoi(argv[++argi]);
+            if (strassen_cutoff < 0) strassen_cutoff = 0;
+        } else if (strcmp(argv[argi], "--bench") == 0) {
+            bench = 1;
+        } else if (strcmp(argv[argi], "--bench-sparse") == 0) {
+            bench_sparse = 1;
+        } else if (strcmp(argv[argi], "--bench-strassen") == 0) {
+            bench_strassen = 1;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (bench) {
+        benchmark_multiply(argi < argc ? atoi(argv[argi]) : 1024);
+        return 0;
+    }
+    if (bench_strassen) {
+        benchmark_strassen(argi < argc ? atoi(argv[argi]) : 2048);
+        return 0;
+    }
+    if (bench_sparse) {
+        benchmark_sparse(argi < argc ? atoi(argv[argi]) : 1024);
+        return 0;
+    }
+    if (argc - argi != 1) {
+        usage(argv[0]);
         return 1;
     }
     // Open file
-    FILE *file = fopen(argv[1], "r");
+    FILE *file = fopen(argv[argi], "r");
     if (!file) {
         perror("Error opening file");
         return 1;
@@ -108,15 +1040,14 @@ int main(int argc, char *argv[]) {
     fscanf(file, "%d", &k); // Read matrix size
 
     // Allocate memory for matrix
-    int **M = (int **)malloc(k * sizeof(int *));
-    for (int i = 0; i < k; i++) {
-        M[i] = (int *)malloc(k * sizeof(int));
-    }
+    Matrix *M = create_matrix(k);
 
     // Read matrix values
     for (int i = 0; i < k; i++) {
         for (int j = 0; j < k; j++) {
-            fscanf(file, "%d", &M[i][j]);
+            long long value;
+            fscanf(file, "%lld", &value);
+            set_element(M, i, j, value);
         }
     }
     int n;
@@ -126,12 +1057,11 @@ int main(int argc, char *argv[]) {
     fclose(file);
 
     // Perform matrix exponentiation
-    matrix_exponentiation(M, k, n);
+    int ok = matrix_exponentiation(M, n);
+    if (!ok)
+        fprintf(stderr, "Overflow: result does not fit in 64 bits\n");
 
     // Free allocated memory
-    for (int i = 0; i < k; i++) {
-        free(M[i]);
-    }
-    free(M);
-    return 0;
-}
\ No newline at end of file
+    free_matrix(M);
+    return ok ? 0 : 1;
+}
@@ -1,6 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
 #include <stdio.h>
 #include <ctype.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#define BLOCK_SIZE (1 << 20) // bytes read at a time in --lines / --file mode
+#define SLACK 32 // letter buffers keep this much room past the end for 8-byte stores
 
 // Function to check if a string is a palindrome.
 int is_palindrome(const char *str) {
@@ -27,10 +40,317 @@ int is_palindrome(const char *str) {
     return 1; // returns 1 if it a palindrome
 }
 
+// The streaming checker splits the test in two: fold_letters keeps only the
+// letters of the input, lower-cased, and is_mirrored compares that sequence
+// with its reverse. A string is a palindrome exactly when its folded letters are.
+
+#ifdef __AVX2__
+// compact_table[m] lists, in order, the positions of the set bits of m as
+// pshufb indexes, so one shuffle packs the selected bytes of an 8-byte group
+static uint64_t compact_table[256];
+
+static void init_compact_table(void) {
+    for (int m = 0; m < 256; m++) {
+        uint64_t entry = 0x8080808080808080ull;
+        int count = 0;
+        for (int b = 0; b < 8; b++) {
+            if (m & (1 << b)) {
+                entry &= ~(0xFFull << (8 * count));
+                entry |= (uint64_t)b << (8 * count);
+                count++;
+            }
+        }
+        compact_table[m] = entry;
+    }
+}
+#endif
+
+// Writes the letters of src, lower-cased, to dst and returns how many there
+// were; dst needs SLACK bytes of room past that count
+size_t fold_letters(char *dst, const char *src, size_t length) {
+    size_t count = 0, i = 0;
+#ifdef __AVX2__
+    const __m256i case_bit = _mm256_set1_epi8(0x20);
+    const __m256i lower_a = _mm256_set1_epi8('a');
+    const __m256i last = _mm256_set1_epi8(25);
+    for (; i + 32 <= length; i += 32) {
+        __m256i lower = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(src + i)), case_bit);
+        __m256i offset = _mm256_sub_epi8(lower, lower_a);
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(offset, last), offset));
+        if (mask == 0) continue;
+        if (mask == 0xFFFFFFFFu) { // all letters: no packing needed
+            _mm256_storeu_si256((__m256i *)(dst + count), lower);
+            count += 32;
+            continue;
+        }
+        __m128i halves[2] = { _mm256_castsi256_si128(lower), _mm256_extracti128_si256(lower, 1) };
+        for (int g = 0; g < 4; g++) {
+            unsigned m = (mask >> (8 * g)) & 0xFF;
+            __m128i group = g & 1 ? _mm_srli_si128(halves[g >> 1], 8) : halves[g >> 1];
+            __m128i packed = _mm_shuffle_epi8(group, _mm_cvtsi64_si128((long long)compact_table[m]));
+            _mm_storel_epi64((__m128i *)(dst + count), packed);
+            count += __builtin_popcount(m);
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        char lower = src[i] | 0x20;
+        dst[count] = lower;
+        count += (unsigned char)(lower - 'a') < 26; // branchless: the store is kept only for letters
+    }
+    return count;
+}
+
+// 1 if the n bytes at s read the same backwards
+int is_mirrored(const char *s, size_t n) {
+    size_t i = 0;
+#ifdef __AVX2__
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; 2 * i + 32 <= n; i += 32) {
+        __m256i front = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i back = _mm256_loadu_si256((const __m256i *)(s + n - i - 32));
+        back = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(back, reverse), 0x4E);
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(front, back)) != 0xFFFFFFFFu) return 0;
+    }
+#endif
+    for (; i + 1 < n - i; i++) {
+        if (s[i] != s[n - 1 - i]) return 0;
+    }
+    return 1;
+}
+
+// 1 if a[t] == b[n - 1 - t] for every t < n, i.e. a matches b read backwards
+static int matches_reversed(const char *a, const char *b, size_t n) {
+    size_t t = 0;
+#ifdef __AVX2__
+    const __m256i reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                             15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    for (; t + 32 <= n; t += 32) {
+        __m256i front = _mm256_loadu_si256((const __m256i *)(a + t));
+        __m256i back = _mm256_loadu_si256((const __m256i *)(b + n - t - 32));
+        back = _mm256_permute4x64_epi64(_mm256_shuffle_epi8(back, reverse), 0x4E);
+        if ((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(front, back)) != 0xFFFFFFFFu) return 0;
+    }
+#endif
+    for (; t < n; t++) {
+        if (a[t] != b[n - 1 - t]) return 0;
+    }
+    return 1;
+}
+
+// Reads exactly length bytes at offset, or returns 0
+static int read_at(int fd, char *buffer, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t got = pread(fd, buffer, length, offset);
+        if (got <= 0) return 0;
+        buffer += got;
+        length -= got;
+        offset += got;
+    }
+    return 1;
+}
+
+// Whole-stream check of a regular file in bounded memory: one window walks
+// forward from the start and one backward from the end, each BLOCK_SIZE bytes
+// folded at a time, and the letters are compared as they meet. Whatever is
+// left unmatched when the windows meet (at most two blocks) must itself be
+// mirrored. Returns 1/0, or -1 on a read error.
+static int check_file_ends(int fd, off_t start, off_t end) {
+    char *block = (char *)malloc(BLOCK_SIZE);
+    char *front = (char *)malloc(2 * BLOCK_SIZE + SLACK); // room to append the back letters at the end
+    char *back = (char *)malloc(BLOCK_SIZE + SLACK);
+    size_t front_at = 0, front_len = 0, back_len = 0; // front[front_at..front_len) and back[0..back_len) are unmatched
+    int result = 1;
+    while (result == 1) {
+        if (front_at == front_len && start < end) {
+            size_t length = end - start < BLOCK_SIZE ? (size_t)(end - start) : BLOCK_SIZE;
+            if (!read_at(fd, block, length, start)) result = -1;
+            front_at = 0;
+            front_len = fold_letters(front, block, length);
+            start += length;
+        } else if (back_len == 0 && start < end) {
+            size_t length = end - start < BLOCK_SIZE ? (size_t)(end - start) : BLOCK_SIZE;
+            if (!read_at(fd, block, length, end - length)) result = -1;
+            back_len = fold_letters(back, block, length);
+            end -= length;
+        } else if (front_at < front_len && back_len > 0) {
+            size_t n = front_len - front_at < back_len ? front_len - front_at : back_len;
+            if (!matches_reversed(front + front_at, back + back_len - n, n)) result = 0;
+            front_at += n;
+            back_len -= n;
+        } else { // the windows have met: check what is left in the middle
+            memmove(front, front + front_at, front_len - front_at);
+            memcpy(front + front_len - front_at, back, back_len);
+            result = is_mirrored(front, front_len - front_at + back_len);
+            break;
+        }
+    }
+    free(block);
+    free(front);
+    free(back);
+    return result;
+}
+
+// Growable buffer of folded letters
+typedef struct {
+    char *data;
+    size_t length, capacity;
+} Letters;
+
+static void append_letters(Letters *letters, const char *src, size_t length) {
+    if (letters->length + length + SLACK > letters->capacity) {
+        while (letters->length + length + SLACK > letters->capacity)
+            letters->capacity = letters->capacity ? 2 * letters->capacity : 4096;
+        letters->data = (char *)realloc(letters->data, letters->capacity);
+    }
+    letters->length += fold_letters(letters->data + letters->length, src, length);
+}
+
+// Checks a file ("-" for stdin) in BLOCK_SIZE reads: with per_line set, prints
+// yes/no for every line (a line may span reads); otherwise one answer for the
+// whole stream. Whole regular files are read from both ends in bounded memory;
+// only pipes keep all of their letters in memory.
+int check_stream(const char *path, int per_line) {
+    FILE *file = strcmp(path, "-") == 0 ? stdin : fopen(path, "rb");
+    if (!file) {
+        perror("Error opening file");
+        return 1;
+    }
+    struct stat st;
+    int fd = fileno(file);
+    if (!per_line && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        off_t start = lseek(fd, 0, SEEK_CUR);
+        int result = check_file_ends(fd, start < 0 ? 0 : start, st.st_size);
+        if (file != stdin) fclose(file);
+        if (result < 0) {
+            perror("Error reading file");
+            return 1;
+        }
+        printf(result ? "yes\n" : "no\n");
+        return 0;
+    }
+    char *block = (char *)malloc(BLOCK_SIZE);
+    Letters letters = { NULL, 0, 0 };
+    append_letters(&letters, "", 0);
+    int pending = 0; // bytes seen since the last newline
+    size_t got;
+    while ((got = fread(block, 1, BLOCK_SIZE, file)) > 0) {
+        size_t start = 0;
+        while (start < got) {
+            const char *newline = per_line ? memchr(block + start, '\n', got - start) : NULL;
+            size_t end = newline ? (size_t)(newline - block) : got;
+            append_letters(&letters, block + start, end - start);
+            pending |= end > start;
+            start = end;
+            if (newline) {
+                printf(is_mirrored(letters.data, letters.length) ? "yes\n" : "no\n");
+                letters.length = 0;
+                pending = 0;
+                start++;
+            }
+        }
+    }
+    if (!per_line || pending)
+        printf(is_mirrored(letters.data, letters.length) ? "yes\n" : "no\n");
+    free(letters.data);
+    free(block);
+    if (file != stdin) fclose(file);
+    return 0;
+}
+
+static double elapsed_seconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Compares is_palindrome against fold_letters + is_mirrored on megabytes of
+// generated lines, about half of them palindromes with mixed case and punctuation
+void benchmark_palindrome(long megabytes) {
+    size_t length = (size_t)megabytes << 20;
+    char *text = (char *)malloc(length + 1);
+    static const char filler[] = " ,.;:-'!?0123456789";
+    srand(211);
+    size_t pos = 0;
+    long lines = 0;
+    while (pos < length) {
+        size_t line = 20 + rand() % 2000;
+        if (pos + line + 1 > length) line = length - pos - 1;
+        char *start = text + pos;
+        for (size_t k = 0; k < line; k++) {
+            int r = rand() % 8;
+            start[k] = r == 0 ? filler[rand() % (sizeof(filler) - 1)] : (char)('a' + rand() % 26);
+        }
+        if (rand() % 2) { // mirror the first half
+            for (size_t l = 0, r = line ? line - 1 : 0; l < r; l++, r--) start[r] = start[l];
+        }
+        for (size_t k = 0; k < line; k++) {
+            if (rand() % 4 == 0) start[k] = (char)toupper(start[k]);
+        }
+        start[line] = '\n';
+        pos += line + 1;
+        lines++;
+    }
+    text[length] = '\0';
+
+    struct timespec start;
+    long slow_yes = 0, fast_yes = 0, mismatches = 0;
+    char *answers = (char *)malloc(lines);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long n = 0;
+    for (char *line = text; line < text + length; n++) {
+        char *newline = strchr(line, '\n');
+        *newline = '\0';
+        answers[n] = (char)is_palindrome(line);
+        slow_yes += answers[n];
+        *newline = '\n';
+        line = newline + 1;
+    }
+    double slow_time = elapsed_seconds(&start);
+
+    Letters letters = { NULL, 0, 0 };
+    append_letters(&letters, "", 0);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    n = 0;
+    for (char *line = text; line < text + length; n++) {
+        char *newline = memchr(line, '\n', text + length - line);
+        letters.length = 0;
+        append_letters(&letters, line, newline - line);
+        int yes = is_mirrored(letters.data, letters.length);
+        fast_yes += yes;
+        mismatches += yes != answers[n];
+        line = newline + 1;
+    }
+    double fast_time = elapsed_seconds(&start);
+
+    printf("%.1f MB, %ld lines, %ld palindromes\n", length / 1e6, lines, fast_yes);
+    printf("is_palindrome:   %8.1f ms %8.2f GB/s\n", slow_time * 1e3, length / slow_time / 1e9);
+    printf("fold + mirrored: %8.1f ms %8.2f GB/s\n", fast_time * 1e3, length / fast_time / 1e9);
+    printf("mismatches:      %ld\n", mismatches + (slow_yes != fast_yes));
+    free(letters.data);
+    free(answers);
+    free(text);
+}
+
 int main(int argc, char *argv[]) {
+#ifdef __AVX2__
+    init_compact_table();
+#endif
+    if (argc == 3 && strcmp(argv[1], "--lines") == 0) //one answer per line of a file or standard input
+        return check_stream(argv[2], 1);
+    if (argc == 3 && strcmp(argv[1], "--file") == 0) //one answer for the whole stream
+        return check_stream(argv[2], 0);
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "--bench") == 0) {
+        benchmark_palindrome(argc == 3 ? atol(argv[2]) : 256);
+        return 0;
+    }
     if (argc != 2) //checks whether arguments passed is not equal to 2
     {
         printf("Usage: %s <string>\n", argv[0]);
+        printf("       %s --lines <path|->\n", argv[0]);
+        printf("       %s --file <path|->   (regular files in bounded memory; a pipe's letters are kept in memory)\n", argv[0]);
+        printf("       %s --bench [MB]\n", argv[0]);
         return 1;
     }
 
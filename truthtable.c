@@ -1,283 +1,655 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <ctype.h>
-
-#define MAX_VARS 10000
-#define MAX_INPUTS 200
-#define MAX_GATES 10000
-#define MAX_NAME_LEN 17
-
-typedef enum {
-    GATE_AND, GATE_OR, GATE_NAND, GATE_NOR, GATE_XOR,
-    GATE_NOT, GATE_PASS, GATE_DECODER, GATE_MULTIPLEXER
-} GateType;
-
-typedef struct {
-    GateType type;
-    int size;
-    int *params;
-} Gate;
-
-typedef struct {
-    int input_count;
-    int output_count;
-    int var_count;
-    int inputs[MAX_INPUTS];
-    int outputs[MAX_INPUTS];
-    Gate gates[MAX_GATES];
-    int gate_count;
-    char variableNames[MAX_VARS][MAX_NAME_LEN];
-    int eval_order[MAX_GATES];
-    int eval_order_size;
-} Circuit;
-
-static Circuit circuit;
-static int values[MAX_VARS];
-static int is_input[MAX_VARS] = {0};
-static int var_to_gate[MAX_VARS];
-
-static int zeroVar = -1;
-static int oneVar = -1;
-
-static int getOrCreateVariable(const char *name) {
-    if (strcmp(name, "0") == 0) {
-        if (zeroVar == -1) {
-            zeroVar = circuit.var_count;
-            strcpy(circuit.variableNames[circuit.var_count++], "0");
-        }
-        return zeroVar;
-    }
-    if (strcmp(name, "1") == 0) {
-        if (oneVar == -1) {
-            oneVar = circuit.var_count;
-            strcpy(circuit.variableNames[circuit.var_count++], "1");
-        }
-        return oneVar;
-    }
-    if (strcmp(name, "_") == 0) {
-        int idx = circuit.var_count;
-        strcpy(circuit.variableNames[circuit.var_count++], "_discard");
-        return idx;
-    }
-    for (int i = 0; i < circuit.var_count; i++) {
-        if (strcmp(circuit.variableNames[i], name) == 0) return i;
-    }
-    strcpy(circuit.variableNames[circuit.var_count], name);
-    return circuit.var_count++;
-}
-
-static void parseGate(FILE *file, GateType type) {
-    Gate gate;
-    gate.type = type;
-    gate.size = 0;
-    gate.params = NULL;
-
-    if (type == GATE_NOT || type == GATE_PASS) {
-        gate.params = malloc(sizeof(int) * 2);
-        char in[MAX_NAME_LEN], out[MAX_NAME_LEN];
-        fscanf(file, "%16s %16s", in, out);
-        gate.params[0] = getOrCreateVariable(in);
-        gate.params[1] = getOrCreateVariable(out);
-    } else if (type == GATE_AND || type == GATE_OR || type == GATE_XOR ||
-               type == GATE_NAND || type == GATE_NOR) {
-        gate.params = malloc(sizeof(int) * 3);
-        char in1[MAX_NAME_LEN], in2[MAX_NAME_LEN], out[MAX_NAME_LEN];
-        fscanf(file, "%16s %16s %16s", in1, in2, out);
-        gate.params[0] = getOrCreateVariable(in1);
-        gate.params[1] = getOrCreateVariable(in2);
-        gate.params[2] = getOrCreateVariable(out);
-    } else if (type == GATE_DECODER) {
-        int n;
-        fscanf(file, "%d", &n);
-        gate.size = n;
-        int total = n + (1 << n);
-        gate.params = malloc(sizeof(int) * total);
-        for (int i = 0; i < total; i++) {
-            char name[MAX_NAME_LEN];
-            fscanf(file, "%16s", name);
-            gate.params[i] = getOrCreateVariable(name);
-        }
-    } else if (type == GATE_MULTIPLEXER) {
-        int n;
-        fscanf(file, "%d", &n);
-        gate.size = n;
-        int total = (1 << n) + n + 1;
-        gate.params = malloc(sizeof(int) * total);
-        for (int i = 0; i < total; i++) {
-            char name[MAX_NAME_LEN];
-            fscanf(file, "%16s", name);
-            gate.params[i] = getOrCreateVariable(name);
-        }
-    }
-
-    circuit.gates[circuit.gate_count++] = gate;
-}
-
-static void buildEvaluationOrder() {
-    memset(var_to_gate, -1, sizeof(var_to_gate));
-
-    for (int i = 0; i < circuit.gate_count; i++) {
-        Gate *g = &circuit.gates[i];
-        int *out = NULL, out_count = 0;
-        switch (g->type) {
-            case GATE_NOT: case GATE_PASS: out = &g->params[1]; out_count = 1; break;
-            case GATE_AND: case GATE_OR: case GATE_XOR: case GATE_NAND: case GATE_NOR:
-                out = &g->params[2]; out_count = 1; break;
-            case GATE_DECODER:
-                out = &g->params[g->size]; out_count = (1 << g->size); break;
-            case GATE_MULTIPLEXER:
-                out = &g->params[(1 << g->size) + g->size]; out_count = 1; break;
-            default: break;
-        }
-        for (int j = 0; j < out_count; j++) {
-            int var = out[j];
-            if (strcmp(circuit.variableNames[var], "_discard") == 0) continue;
-            var_to_gate[var] = i;
-        }
-    }
-
-    int **adj = malloc(sizeof(int*) * MAX_GATES);
-    for (int i = 0; i < MAX_GATES; i++) adj[i] = calloc(MAX_GATES, sizeof(int));
-    int adj_size[MAX_GATES] = {0}, in_deg[MAX_GATES] = {0};
-
-    for (int i = 0; i < circuit.gate_count; i++) {
-        Gate *g = &circuit.gates[i];
-        int *in = NULL, in_count = 0;
-        switch (g->type) {
-            case GATE_NOT: case GATE_PASS: in = &g->params[0]; in_count = 1; break;
-            case GATE_AND: case GATE_OR: case GATE_XOR: case GATE_NAND: case GATE_NOR:
-                in = g->params; in_count = 2; break;
-            case GATE_DECODER: in = g->params; in_count = g->size; break;
-            case GATE_MULTIPLEXER: in = g->params; in_count = (1 << g->size) + g->size; break;
-            default: break;
-        }
-
-        for (int j = 0; j < in_count; j++) {
-            int var = in[j];
-            if (is_input[var] || strcmp(circuit.variableNames[var], "0") == 0 ||
-                strcmp(circuit.variableNames[var], "1") == 0 || 
-                strcmp(circuit.variableNames[var], "_discard") == 0) continue;
-
-            int prod = var_to_gate[var];
-            adj[prod][adj_size[prod]++] = i;
-            in_deg[i]++;
-        }
-    }
-
-    int queue[MAX_GATES], front = 0, rear = 0;
-    circuit.eval_order_size = 0;
-    for (int i = 0; i < circuit.gate_count; i++) if (!in_deg[i]) queue[rear++] = i;
-
-    while (front < rear) {
-        int u = queue[front++];
-        circuit.eval_order[circuit.eval_order_size++] = u;
-        for (int i = 0; i < adj_size[u]; i++) {
-            int v = adj[u][i];
-            if (--in_deg[v] == 0) queue[rear++] = v;
-        }
-    }
-
-    if (circuit.eval_order_size != circuit.gate_count) {
-        fprintf(stderr, "Cycle detected\n");
-        exit(EXIT_FAILURE);
-    }
-
-    for (int i = 0; i < MAX_GATES; i++) free(adj[i]);
-    free(adj);
-}
-
-static void evaluateGate(const Gate *g) {
-    switch (g->type) {
-        case GATE_NOT: values[g->params[1]] = !values[g->params[0]]; break;
-        case GATE_PASS: values[g->params[1]] = values[g->params[0]]; break;
-        case GATE_AND: values[g->params[2]] = values[g->params[0]] & values[g->params[1]]; break;
-        case GATE_OR: values[g->params[2]] = values[g->params[0]] | values[g->params[1]]; break;
-        case GATE_XOR: values[g->params[2]] = values[g->params[0]] ^ values[g->params[1]]; break;
-        case GATE_NAND: values[g->params[2]] = !(values[g->params[0]] & values[g->params[1]]); break;
-        case GATE_NOR: values[g->params[2]] = !(values[g->params[0]] | values[g->params[1]]); break;
-        case GATE_DECODER: {
-            int in = 0;
-            for (int i = 0; i < g->size; i++) in = (in << 1) | values[g->params[i]];
-            for (int i = 0; i < (1 << g->size); i++) values[g->params[g->size + i]] = (i == in);
-            break;
-        }
-        case GATE_MULTIPLEXER: {
-            int sel = 0;
-            for (int i = 0; i < g->size; i++) sel = (sel << 1) | values[g->params[(1 << g->size) + i]];
-            values[g->params[(1 << g->size) + g->size]] = values[g->params[sel]];
-            break;
-        }
-    }
-}
-
-static void printTruthRow() {
-    for (int i = 0; i < circuit.input_count; i++) printf("%d ", values[circuit.inputs[i]]);
-    printf("| ");
-    for (int i = 0; i < circuit.output_count; i++) {
-        printf("%d", values[circuit.outputs[i]]);
-        if (i < circuit.output_count - 1) printf(" ");
-    }
-    putchar('\n');
-}
-
-static void generateTruthTable() {
-    memset(values, 0, sizeof(values));
-    if (zeroVar != -1) values[zeroVar] = 0;
-    if (oneVar != -1) values[oneVar] = 1;
-
-    for (int row = 0; row < (1 << circuit.input_count); row++) {
-        for (int i = 0; i < circuit.input_count; i++)
-            values[circuit.inputs[i]] = (row >> (circuit.input_count - 1 - i)) & 1;
-        for (int i = 0; i < circuit.eval_order_size; i++)
-            evaluateGate(&circuit.gates[circuit.eval_order[i]]);
-        printTruthRow();
-    }
-}
-
-static void parseCircuitFile(const char *filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) { perror("Error opening file"); exit(EXIT_FAILURE); }
-
-    circuit = (Circuit){0}; zeroVar = oneVar = -1;
-    char directive[32];
-
-    fscanf(file, "%16s %d", directive, &circuit.input_count);
-    for (int i = 0; i < circuit.input_count; i++) {
-        char name[MAX_NAME_LEN]; fscanf(file, "%16s", name);
-        int var = getOrCreateVariable(name);
-        circuit.inputs[i] = var; is_input[var] = 1;
-    }
-
-    fscanf(file, "%16s %d", directive, &circuit.output_count);
-    for (int i = 0; i < circuit.output_count; i++) {
-        char name[MAX_NAME_LEN]; fscanf(file, "%16s", name);
-        circuit.outputs[i] = getOrCreateVariable(name);
-    }
-
-    while (fscanf(file, "%16s", directive) == 1) {
-        if (strcmp(directive, "NOT") == 0) parseGate(file, GATE_NOT);
-        else if (strcmp(directive, "AND") == 0) parseGate(file, GATE_AND);
-        else if (strcmp(directive, "OR") == 0) parseGate(file, GATE_OR);
-        else if (strcmp(directive, "XOR") == 0) parseGate(file, GATE_XOR);
-        else if (strcmp(directive, "NAND") == 0) parseGate(file, GATE_NAND);
-        else if (strcmp(directive, "NOR") == 0) parseGate(file, GATE_NOR);
-        else if (strcmp(directive, "PASS") == 0) parseGate(file, GATE_PASS);
-        else if (strcmp(directive, "DECODER") == 0) parseGate(file, GATE_DECODER);
-        else if (strcmp(directive, "MULTIPLEXER") == 0) parseGate(file, GATE_MULTIPLEXER);
-        else { fprintf(stderr, "Invalid directive: %s\n", directive); exit(EXIT_FAILURE); }
-    }
-
-    fclose(file);
-    buildEvaluationOrder();
-}
-
-int main(int argc, char **argv) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <circuit_file>\n", argv[0]);
-        return 1;
-    }
-    parseCircuitFile(argv[1]);
-    generateTruthTable();
-    return 0;
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef enum {
+    GATE_AND, GATE_OR, GATE_NAND, GATE_NOR, GATE_XOR,
+    GATE_NOT, GATE_PASS, GATE_DECODER, GATE_MULTIPLEXER
+} GateType;
+
+// A gate's variables live in circuit.params starting at param_base
+typedef struct {
+    GateType type;
+    int size;
+    int param_base;
+} Gate;
+
+typedef struct {
+    int input_count;
+    int output_count;
+    int var_count, var_cap;
+    int *inputs;
+    int *outputs;
+    Gate *gates;
+    int gate_count, gate_cap;
+    int *params;
+    size_t param_count, param_cap;
+    char *names;
+    size_t names_size, names_cap;
+    size_t *name_offset;
+    unsigned char *is_discard;
+    int *name_table;
+    size_t name_table_cap;
+    int *eval_order;
+    int eval_order_size;
+    int *level_start;
+    int level_count;
+} Circuit;
+
+static Circuit circuit;
+static uint64_t *values;
+static unsigned char *is_input;
+static int *var_to_gate;
+
+static int zeroVar = -1;
+static int oneVar = -1;
+
+#define GROW(arr, cap, need) do { \
+    if ((size_t)(need) > (size_t)(cap)) { \
+        size_t newCap = (cap) ? (size_t)(cap) : 16; \
+        while (newCap < (size_t)(need)) newCap *= 2; \
+        (arr) = realloc((arr), sizeof(*(arr)) * newCap); \
+        if (!(arr)) { perror("Out of memory"); exit(EXIT_FAILURE); } \
+        (cap) = newCap; \
+    } \
+} while (0)
+
+static inline int *gateParams(const Gate *g) {
+    return circuit.params + g->param_base;
+}
+
+static void freeCircuit() {
+    free(circuit.inputs); free(circuit.outputs);
+    free(circuit.gates); free(circuit.params);
+    free(circuit.names); free(circuit.name_offset); free(circuit.is_discard);
+    free(circuit.name_table); free(circuit.eval_order); free(circuit.level_start);
+    free(values); free(is_input); free(var_to_gate);
+    values = NULL; is_input = NULL; var_to_gate = NULL;
+    circuit = (Circuit){0};
+    zeroVar = oneVar = -1;
+}
+
+static unsigned hashName(const char *name, int len) {
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++) h = (h ^ (unsigned char)name[i]) * 16777619u;
+    return h;
+}
+
+static int addVariable(const char *name, int len, int discard) {
+    if (circuit.var_count + 1 > circuit.var_cap) { //is_discard follows name_offset's capacity
+        GROW(circuit.name_offset, circuit.var_cap, circuit.var_count + 1);
+        circuit.is_discard = realloc(circuit.is_discard, circuit.var_cap);
+        if (!circuit.is_discard) { perror("Out of memory"); exit(EXIT_FAILURE); }
+    }
+    GROW(circuit.names, circuit.names_cap, circuit.names_size + len + 1);
+
+    int idx = circuit.var_count++;
+    circuit.name_offset[idx] = circuit.names_size;
+    circuit.is_discard[idx] = (unsigned char)discard;
+    memcpy(circuit.names + circuit.names_size, name, len);
+    circuit.names[circuit.names_size + len] = '\0';
+    circuit.names_size += len + 1;
+    return idx;
+}
+
+// Open-addressed table of named variables, kept at most half full
+static void rehashNames(size_t cap) {
+    free(circuit.name_table);
+    circuit.name_table = malloc(sizeof(int) * cap);
+    if (!circuit.name_table) { perror("Out of memory"); exit(EXIT_FAILURE); }
+    memset(circuit.name_table, -1, sizeof(int) * cap);
+    circuit.name_table_cap = cap;
+    for (int v = 0; v < circuit.var_count; v++) {
+        if (circuit.is_discard[v]) continue;
+        const char *s = circuit.names + circuit.name_offset[v];
+        size_t slot = hashName(s, (int)strlen(s)) & (cap - 1);
+        while (circuit.name_table[slot] != -1) slot = (slot + 1) & (cap - 1);
+        circuit.name_table[slot] = v;
+    }
+}
+
+static int getOrCreateVariable(const char *name, int len) {
+    if (len == 1 && name[0] == '0') {
+        if (zeroVar == -1) zeroVar = addVariable("0", 1, 0);
+        return zeroVar;
+    }
+    if (len == 1 && name[0] == '1') {
+        if (oneVar == -1) oneVar = addVariable("1", 1, 0);
+        return oneVar;
+    }
+    if (len == 1 && name[0] == '_') return addVariable("_discard", 8, 1);
+
+    if (2 * (size_t)(circuit.var_count + 1) > circuit.name_table_cap)
+        rehashNames(circuit.name_table_cap ? circuit.name_table_cap * 2 : 1024);
+
+    size_t mask = circuit.name_table_cap - 1;
+    size_t slot = hashName(name, len) & mask;
+    for (int v; (v = circuit.name_table[slot]) != -1; slot = (slot + 1) & mask) {
+        // Names are stored back to back, so the next offset gives this one's length
+        size_t stored = (v + 1 < circuit.var_count ? circuit.name_offset[v + 1] : circuit.names_size)
+                        - circuit.name_offset[v] - 1;
+        if (stored == (size_t)len && memcmp(circuit.names + circuit.name_offset[v], name, len) == 0) return v;
+    }
+    int v = addVariable(name, len, 0);
+    circuit.name_table[slot] = v;
+    return v;
+}
+
+// Tokenizer over the mapped netlist; tokens are runs of non-whitespace
+typedef struct {
+    const char *cur;
+    const char *end;
+} Lexer;
+
+static inline int isBlank(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static int nextToken(Lexer *lx, const char **tok) {
+    const char *p = lx->cur, *end = lx->end;
+    while (p < end && isBlank(*p)) p++;
+    const char *start = p;
+    while (p < end && !isBlank(*p)) p++;
+    lx->cur = p;
+    *tok = start;
+    return (int)(p - start);
+}
+
+static int expectVariable(Lexer *lx) {
+    const char *tok;
+    int len = nextToken(lx, &tok);
+    if (len == 0) { fprintf(stderr, "Unexpected end of circuit file\n"); exit(EXIT_FAILURE); }
+    return getOrCreateVariable(tok, len);
+}
+
+static int expectCount(Lexer *lx) {
+    const char *tok;
+    int len = nextToken(lx, &tok);
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (tok[i] < '0' || tok[i] > '9' || n > 100000000) len = 0;
+        else n = n * 10 + (tok[i] - '0');
+    }
+    if (len == 0) { fprintf(stderr, "Expected a count in circuit file\n"); exit(EXIT_FAILURE); }
+    return n;
+}
+
+static void parseGate(Lexer *lx, GateType type) {
+    Gate gate;
+    gate.type = type;
+    gate.size = 0;
+
+    int total;
+    if (type == GATE_NOT || type == GATE_PASS) {
+        total = 2;
+    } else if (type == GATE_DECODER) {
+        gate.size = expectCount(lx);
+        total = gate.size + (1 << gate.size);
+    } else if (type == GATE_MULTIPLEXER) {
+        gate.size = expectCount(lx);
+        total = (1 << gate.size) + gate.size + 1;
+    } else {
+        total = 3;
+    }
+
+    GROW(circuit.params, circuit.param_cap, circuit.param_count + total);
+    gate.param_base = (int)circuit.param_count;
+    for (int i = 0; i < total; i++)
+        circuit.params[circuit.param_count++] = expectVariable(lx);
+
+    GROW(circuit.gates, circuit.gate_cap, circuit.gate_count + 1);
+    circuit.gates[circuit.gate_count++] = gate;
+}
+
+static int *gateOutputs(const Gate *g, int *count) {
+    int *p = gateParams(g);
+    switch (g->type) {
+        case GATE_NOT: case GATE_PASS: *count = 1; return &p[1];
+        case GATE_DECODER: *count = 1 << g->size; return &p[g->size];
+        case GATE_MULTIPLEXER: *count = 1; return &p[(1 << g->size) + g->size];
+        default: *count = 1; return &p[2];
+    }
+}
+
+static int *gateInputs(const Gate *g, int *count) {
+    switch (g->type) {
+        case GATE_NOT: case GATE_PASS: *count = 1; break;
+        case GATE_DECODER: *count = g->size; break;
+        case GATE_MULTIPLEXER: *count = (1 << g->size) + g->size; break;
+        default: *count = 2; break;
+    }
+    return gateParams(g);
+}
+
+// Returns the gate that drives var, or -1 for inputs, constants and undriven variables
+static int producerOf(int var) {
+    if (is_input[var] || var == zeroVar || var == oneVar || circuit.is_discard[var]) return -1;
+    return var_to_gate[var];
+}
+
+static void buildEvaluationOrder() {
+    int gate_count = circuit.gate_count;
+    var_to_gate = malloc(sizeof(int) * (circuit.var_count + 1));
+    memset(var_to_gate, -1, sizeof(int) * (circuit.var_count + 1));
+
+    for (int i = 0; i < gate_count; i++) {
+        int out_count, *out = gateOutputs(&circuit.gates[i], &out_count);
+        for (int j = 0; j < out_count; j++) {
+            int var = out[j];
+            if (circuit.is_discard[var]) continue;
+            var_to_gate[var] = i;
+        }
+    }
+
+    // Producer -> consumer edges in CSR form: adj[adj_start[u] .. adj_start[u + 1])
+    int *adj_start = calloc(gate_count + 2, sizeof(int));
+    int *in_deg = calloc(gate_count + 1, sizeof(int));
+    for (int i = 0; i < gate_count; i++) {
+        int in_count, *in = gateInputs(&circuit.gates[i], &in_count);
+        for (int j = 0; j < in_count; j++) {
+            int prod = producerOf(in[j]);
+            if (prod < 0) continue;
+            adj_start[prod + 2]++;
+            in_deg[i]++;
+        }
+    }
+    for (int i = 0; i < gate_count; i++) adj_start[i + 2] += adj_start[i + 1];
+    int *adj = malloc(sizeof(int) * (adj_start[gate_count + 1] + 1));
+    for (int i = 0; i < gate_count; i++) {
+        int in_count, *in = gateInputs(&circuit.gates[i], &in_count);
+        for (int j = 0; j < in_count; j++) {
+            int prod = producerOf(in[j]);
+            if (prod >= 0) adj[adj_start[prod + 1]++] = i;
+        }
+    }
+
+    int *queue = malloc(sizeof(int) * (gate_count + 1)), front = 0, rear = 0;
+    circuit.eval_order = malloc(sizeof(int) * (gate_count + 1));
+    circuit.eval_order_size = 0;
+    for (int i = 0; i < gate_count; i++) if (!in_deg[i]) queue[rear++] = i;
+
+    while (front < rear) {
+        int u = queue[front++];
+        circuit.eval_order[circuit.eval_order_size++] = u;
+        for (int e = adj_start[u]; e < adj_start[u + 1]; e++) {
+            int v = adj[e];
+            if (--in_deg[v] == 0) queue[rear++] = v;
+        }
+    }
+
+    if (circuit.eval_order_size != gate_count) {
+        fprintf(stderr, "Cycle detected\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Levelize: a gate's depth is one more than its deepest producer. Regroup
+    // eval_order by depth so every level is a contiguous, independent slice.
+    int *level = queue;
+    circuit.level_count = 0;
+    for (int i = 0; i < gate_count; i++) {
+        int g = circuit.eval_order[i], depth = 0;
+        int in_count, *in = gateInputs(&circuit.gates[g], &in_count);
+        for (int j = 0; j < in_count; j++) {
+            int prod = producerOf(in[j]);
+            if (prod >= 0 && level[prod] + 1 > depth) depth = level[prod] + 1;
+        }
+        level[g] = depth;
+        if (depth + 1 > circuit.level_count) circuit.level_count = depth + 1;
+    }
+    circuit.level_start = calloc(circuit.level_count + 2, sizeof(int));
+    for (int g = 0; g < gate_count; g++) circuit.level_start[level[g] + 2]++;
+    for (int l = 0; l < circuit.level_count; l++) circuit.level_start[l + 2] += circuit.level_start[l + 1];
+    int *grouped = malloc(sizeof(int) * (gate_count + 1));
+    for (int i = 0; i < gate_count; i++) {
+        int g = circuit.eval_order[i];
+        grouped[circuit.level_start[level[g] + 1]++] = g;
+    }
+    free(circuit.eval_order);
+    circuit.eval_order = grouped;
+
+    free(queue);
+    free(adj);
+    free(adj_start);
+    free(in_deg);
+}
+
+// Each variable holds `words` 64-bit words; bit j of word w is row 64 * w + j
+static void evaluateGate(const Gate *g, int words) {
+    const int *p = gateParams(g);
+#define VAR(v) (values + (size_t)(v) * words)
+    switch (g->type) {
+        case GATE_NOT: case GATE_PASS: {
+            const uint64_t *a = VAR(p[0]);
+            uint64_t *out = VAR(p[1]), flip = g->type == GATE_NOT ? ~0ull : 0;
+            for (int w = 0; w < words; w++) out[w] = a[w] ^ flip;
+            break;
+        }
+        case GATE_AND: case GATE_NAND: {
+            const uint64_t *a = VAR(p[0]), *b = VAR(p[1]);
+            uint64_t *out = VAR(p[2]), flip = g->type == GATE_NAND ? ~0ull : 0;
+            for (int w = 0; w < words; w++) out[w] = (a[w] & b[w]) ^ flip;
+            break;
+        }
+        case GATE_OR: case GATE_NOR: {
+            const uint64_t *a = VAR(p[0]), *b = VAR(p[1]);
+            uint64_t *out = VAR(p[2]), flip = g->type == GATE_NOR ? ~0ull : 0;
+            for (int w = 0; w < words; w++) out[w] = (a[w] | b[w]) ^ flip;
+            break;
+        }
+        case GATE_XOR: {
+            const uint64_t *a = VAR(p[0]), *b = VAR(p[1]);
+            uint64_t *out = VAR(p[2]);
+            for (int w = 0; w < words; w++) out[w] = a[w] ^ b[w];
+            break;
+        }
+        case GATE_DECODER: {
+            // Output i is high where the inputs, read MSB first, spell i
+            for (int i = 0; i < (1 << g->size); i++) {
+                uint64_t *out = VAR(p[g->size + i]);
+                for (int w = 0; w < words; w++) out[w] = ~0ull;
+                for (int j = 0; j < g->size; j++) {
+                    const uint64_t *in = VAR(p[j]);
+                    uint64_t flip = ((i >> (g->size - 1 - j)) & 1) ? 0 : ~0ull;
+                    for (int w = 0; w < words; w++) out[w] &= in[w] ^ flip;
+                }
+            }
+            break;
+        }
+        case GATE_MULTIPLEXER: {
+            const int *sel = &p[1 << g->size];
+            uint64_t *out = VAR(p[(1 << g->size) + g->size]);
+            for (int w = 0; w < words; w++) {
+                uint64_t acc = 0;
+                for (int i = 0; i < (1 << g->size); i++) {
+                    uint64_t match = VAR(p[i])[w];
+                    for (int j = 0; j < g->size; j++)
+                        match &= VAR(sel[j])[w] ^ (((i >> (g->size - 1 - j)) & 1) ? 0 : ~0ull);
+                    acc |= match;
+                }
+                out[w] = acc;
+            }
+            break;
+        }
+    }
+#undef VAR
+}
+
+// Sets the input words for rows starting at first_row (a multiple of 64)
+static void loadInputWords(int first_row, int words) {
+    static const uint64_t lowBitPattern[6] = {
+        0xAAAAAAAAAAAAAAAAull, 0xCCCCCCCCCCCCCCCCull, 0xF0F0F0F0F0F0F0F0ull,
+        0xFF00FF00FF00FF00ull, 0xFFFF0000FFFF0000ull, 0xFFFFFFFF00000000ull,
+    };
+    for (int i = 0; i < circuit.input_count; i++) {
+        int bit = circuit.input_count - 1 - i;
+        uint64_t *in = values + (size_t)circuit.inputs[i] * words;
+        for (int w = 0; w < words; w++) {
+            long long row = first_row + 64LL * w;
+            in[w] = bit < 6 ? lowBitPattern[bit] : (((row >> bit) & 1) ? ~0ull : 0);
+        }
+    }
+}
+
+typedef struct {
+    int id;
+    int thread_count;
+    int words;
+    pthread_barrier_t *barrier;
+    volatile int *done;
+} EvalWorker;
+
+// Evaluates every level, each thread taking a contiguous slice of the level's gates
+static void evaluateLevels(const EvalWorker *wk) {
+    for (int l = 0; l < circuit.level_count; l++) {
+        int first = circuit.level_start[l], n = circuit.level_start[l + 1] - first;
+        int lo = first + (int)((long long)n * wk->id / wk->thread_count);
+        int hi = first + (int)((long long)n * (wk->id + 1) / wk->thread_count);
+        for (int i = lo; i < hi; i++)
+            evaluateGate(&circuit.gates[circuit.eval_order[i]], wk->words);
+        if (wk->thread_count > 1) pthread_barrier_wait(wk->barrier);
+    }
+}
+
+static void *evalWorkerMain(void *arg) {
+    EvalWorker *wk = arg;
+    for (;;) {
+        pthread_barrier_wait(wk->barrier);
+        if (*wk->done) return NULL;
+        evaluateLevels(wk);
+    }
+}
+
+// Formats the rows of one 64-row word into buf, returning the end of the written text
+static char *formatTruthRows(char *buf, int word, int words, int rows) {
+    for (int j = 0; j < rows; j++) {
+        for (int i = 0; i < circuit.input_count; i++) {
+            *buf++ = '0' + ((values[(size_t)circuit.inputs[i] * words + word] >> j) & 1);
+            *buf++ = ' ';
+        }
+        *buf++ = '|';
+        *buf++ = ' ';
+        for (int i = 0; i < circuit.output_count; i++) {
+            *buf++ = '0' + ((values[(size_t)circuit.outputs[i] * words + word] >> j) & 1);
+            if (i < circuit.output_count - 1) *buf++ = ' ';
+        }
+        *buf++ = '\n';
+    }
+    return buf;
+}
+
+static void generateTruthTable(int thread_count) {
+    long long total_rows = 1LL << circuit.input_count;
+    long long total_words = (total_rows + 63) / 64;
+
+    // Rows are processed in batches of `words` words, sized to keep the value table modest
+    long long words = (8 << 20) / (circuit.var_count + 1);
+    if (words > 64) words = 64;
+    if (words < 1) words = 1;
+    if (words > total_words) words = total_words;
+    if (thread_count < 1) thread_count = 1;
+    if (thread_count > 1 && circuit.gate_count < 1024) thread_count = 1;
+
+    values = calloc((size_t)(circuit.var_count + 1) * words, sizeof(uint64_t));
+    if (!values) { perror("Out of memory"); exit(EXIT_FAILURE); }
+    if (oneVar != -1) memset(values + (size_t)oneVar * words, 0xFF, sizeof(uint64_t) * words);
+
+    pthread_barrier_t barrier;
+    volatile int done = 0;
+    EvalWorker *workers = malloc(sizeof(EvalWorker) * thread_count);
+    pthread_t *threads = malloc(sizeof(pthread_t) * thread_count);
+    if (thread_count > 1) pthread_barrier_init(&barrier, NULL, thread_count);
+    for (int t = 0; t < thread_count; t++) {
+        workers[t] = (EvalWorker){ t, thread_count, (int)words, &barrier, &done };
+        if (t > 0) pthread_create(&threads[t], NULL, evalWorkerMain, &workers[t]);
+    }
+
+    size_t line_len = 2 * (size_t)(circuit.input_count + circuit.output_count) + 3;
+    char *out = malloc(line_len * 64 * words);
+
+    for (long long base = 0; base < total_words; base += words) {
+        int batch = (int)(total_words - base < words ? total_words - base : words);
+        loadInputWords((int)(base * 64), (int)words);
+        if (thread_count > 1) pthread_barrier_wait(&barrier);
+        evaluateLevels(&workers[0]);
+
+        char *end = out;
+        for (int w = 0; w < batch; w++) {
+            long long left = total_rows - (base + w) * 64;
+            end = formatTruthRows(end, w, (int)words, left < 64 ? (int)left : 64);
+        }
+        fwrite(out, 1, end - out, stdout);
+    }
+
+    if (thread_count > 1) {
+        done = 1;
+        pthread_barrier_wait(&barrier);
+        for (int t = 1; t < thread_count; t++) pthread_join(threads[t], NULL);
+        pthread_barrier_destroy(&barrier);
+    }
+    free(out);
+    free(threads);
+    free(workers);
+}
+
+static GateType directiveType(const char *tok, int len) {
+    static const struct { const char *name; GateType type; } table[] = {
+        {"NOT", GATE_NOT}, {"AND", GATE_AND}, {"OR", GATE_OR}, {"XOR", GATE_XOR},
+        {"NAND", GATE_NAND}, {"NOR", GATE_NOR}, {"PASS", GATE_PASS},
+        {"DECODER", GATE_DECODER}, {"MULTIPLEXER", GATE_MULTIPLEXER},
+    };
+    for (size_t i = 0; i < sizeof(table) / sizeof(table[0]); i++) {
+        if ((int)strlen(table[i].name) == len && memcmp(table[i].name, tok, len) == 0)
+            return table[i].type;
+    }
+    fprintf(stderr, "Invalid directive: %.*s\n", len, tok);
+    exit(EXIT_FAILURE);
+}
+
+static void parseNetlist(const char *text, size_t size) {
+    Lexer lx = { text, text + size };
+    const char *tok;
+
+    freeCircuit();
+
+    nextToken(&lx, &tok);
+    circuit.input_count = expectCount(&lx);
+    circuit.inputs = malloc(sizeof(int) * (circuit.input_count + 1));
+    for (int i = 0; i < circuit.input_count; i++)
+        circuit.inputs[i] = expectVariable(&lx);
+
+    nextToken(&lx, &tok);
+    circuit.output_count = expectCount(&lx);
+    circuit.outputs = malloc(sizeof(int) * (circuit.output_count + 1));
+    for (int i = 0; i < circuit.output_count; i++)
+        circuit.outputs[i] = expectVariable(&lx);
+
+    int len;
+    while ((len = nextToken(&lx, &tok)) > 0)
+        parseGate(&lx, directiveType(tok, len));
+
+    is_input = calloc(circuit.var_count + 1, 1);
+    for (int i = 0; i < circuit.input_count; i++) is_input[circuit.inputs[i]] = 1;
+}
+
+static void parseCircuitFile(const char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { perror("Error opening file"); exit(EXIT_FAILURE); }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) { perror("Error opening file"); exit(EXIT_FAILURE); }
+    size_t size = (size_t)st.st_size;
+
+    char *text = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (text == MAP_FAILED) {
+        // Empty files and special files cannot be mapped; read them instead
+        size_t cap = 1 << 16;
+        text = malloc(cap);
+        size = 0;
+        for (ssize_t got; (got = read(fd, text + size, cap - size)) > 0; ) {
+            size += (size_t)got;
+            if (size == cap) text = realloc(text, cap *= 2);
+        }
+        parseNetlist(text, size);
+        free(text);
+    } else {
+        posix_madvise(text, size, POSIX_MADV_SEQUENTIAL);
+        parseNetlist(text, size);
+        munmap(text, size);
+    }
+    close(fd);
+    buildEvaluationOrder();
+}
+
+static double elapsedSeconds(const struct timespec *start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+// Writes a random acyclic netlist with the given number of gates
+static void writeRandomNetlist(FILE *out, int inputs, int gates) {
+    unsigned long long seed = 0x9E3779B97F4A7C15ull;
+    static const char *binary[] = {"AND", "OR", "XOR", "NAND", "NOR"};
+
+    fprintf(out, "INPUT %d", inputs);
+    for (int i = 0; i < inputs; i++) fprintf(out, " in%d", i);
+    fprintf(out, "\nOUTPUT 4");
+    for (int i = gates - 4; i < gates; i++) fprintf(out, " w%d", i);
+    fputc('\n', out);
+
+    for (int i = 0; i < gates; i++) {
+        char a[24], b[24], s[24];
+        char *operands[3] = {a, b, s};
+        for (int j = 0; j < 3; j++) {
+            seed ^= seed << 13; seed ^= seed >> 7; seed ^= seed << 17;
+            long pick = (long)(seed % (unsigned long long)(inputs + i));
+            if (pick < inputs) sprintf(operands[j], "in%ld", pick);
+            else sprintf(operands[j], "w%ld", pick - inputs);
+        }
+        switch (seed % 8) {
+            case 0: fprintf(out, "NOT %s w%d\n", a, i); break;
+            case 1: fprintf(out, "MULTIPLEXER 1 %s %s %s w%d\n", a, b, s, i); break;
+            default: fprintf(out, "%s %s %s w%d\n", binary[seed % 5], a, b, i); break;
+        }
+    }
+}
+
+static void benchmarkParse(int max_gates) {
+    printf("%10s %10s %10s %10s %10s\n", "gates", "MB", "parse_ms", "order_ms", "MB/s");
+    for (int gates = 10000; gates <= max_gates; gates *= 10) {
+        char path[] = "/tmp/truthtable_benchXXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) { perror("mkstemp"); exit(EXIT_FAILURE); }
+        FILE *out = fdopen(fd, "w");
+        writeRandomNetlist(out, 16, gates);
+        fclose(out);
+
+        struct stat st;
+        stat(path, &st);
+        int in = open(path, O_RDONLY);
+        char *text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, in, 0);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        parseNetlist(text, st.st_size);
+        double parse = elapsedSeconds(&start);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        buildEvaluationOrder();
+        double order = elapsedSeconds(&start);
+
+        double mb = st.st_size / 1e6;
+        printf("%10d %10.1f %10.2f %10.2f %10.1f\n", gates, mb, parse * 1e3, order * 1e3, mb / parse);
+
+        munmap(text, st.st_size);
+        close(in);
+        unlink(path);
+        freeCircuit();
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 2 && strcmp(argv[1], "--bench-parse") == 0) {
+        benchmarkParse(argc > 2 ? atoi(argv[2]) : 1000000);
+        return 0;
+    }
+    int thread_count = 1;
+    const char *path = argv[1];
+    if (argc == 4 && strcmp(argv[1], "--threads") == 0) {
+        thread_count = atoi(argv[2]);
+        path = argv[3];
+    } else if (argc != 2) {
+        fprintf(stderr, "Usage: %s [--threads N] <circuit_file>\n", argv[0]);
+        return 1;
+    }
+    parseCircuitFile(path);
+    generateTruthTable(thread_count);
+    return 0;
 }
\ No newline at end of file